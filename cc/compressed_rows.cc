@@ -0,0 +1,193 @@
+#include <algorithm>
+#include <cstring>
+#include <limits>
+
+#include "compressed_rows.h"
+
+namespace gseq{
+
+namespace {
+
+int nb_blocks(int degree){
+    return (degree + COMPRESSED_BLOCK_SIZE - 1)/COMPRESSED_BLOCK_SIZE;
+}
+
+
+int skip_table_size(int degree){
+    return sizeof(uint32)*std::max(0, nb_blocks(degree) - 1);
+}
+
+
+int varint_size(uint64 value){
+    int size = 1;
+    while(value >= 0x80){
+        value >>= 7;
+        ++size;
+    }
+    return size;
+}
+
+
+uint8* put_varint(uint64 value, uint8* out){
+    while(value >= 0x80){
+        *out++ = static_cast<uint8>(value | 0x80);
+        value >>= 7;
+    }
+    *out++ = static_cast<uint8>(value);
+    return out;
+}
+
+
+inline uint64 get_varint(const uint8*& in){
+    uint64 value = *in & 0x7f;
+    int shift = 7;
+    while(*in++ & 0x80){
+        value |= static_cast<uint64>(*in & 0x7f) << shift;
+        shift += 7;
+    }
+    return value;
+}
+
+
+// Moves in past a varint, or returns false if the varint does not end
+// before end or is longer than the 10 bytes of a uint64.
+bool skip_varint(const uint8*& in, const uint8* end){
+    for(int i=0; i<10 && in != end; ++i){
+        if(!(*in++ & 0x80))
+            return true;
+    }
+    return false;
+}
+
+
+// Start of block b of the row starting at row.
+inline const uint8* block_start(const uint8* row, int degree, int b){
+    if(b == 0)
+        return row + skip_table_size(degree);
+    uint32 offset;
+    memcpy(&offset, row + sizeof(uint32)*(b-1), sizeof(uint32));
+    return row + offset;
+}
+
+}
+
+
+void compress_rows(const std::vector<EdgeOffset>& offsets, const std::vector<VertexIndex>& idx,
+                   CompressedRows* rows){
+    VertexIndex nb_rows = static_cast<VertexIndex>(offsets.size()) - 1;
+    // Sizes first, so that the bytes are allocated once.
+    rows->starts.resize(nb_rows+1);
+    rows->starts[0] = 0;
+    for(VertexIndex i=0; i<nb_rows; ++i){
+        const VertexIndex* row = idx.data() + offsets[i];
+        int degree = static_cast<int>(offsets[i+1] - offsets[i]);
+        EdgeOffset size = skip_table_size(degree);
+        for(int k=0; k<degree; ++k)
+            size += varint_size(k % COMPRESSED_BLOCK_SIZE == 0 ? row[k] : row[k] - row[k-1]);
+        rows->starts[i+1] = rows->starts[i] + size;
+    }
+    rows->bytes.resize(rows->starts[nb_rows]);
+
+    for(VertexIndex i=0; i<nb_rows; ++i){
+        const VertexIndex* row = idx.data() + offsets[i];
+        int degree = static_cast<int>(offsets[i+1] - offsets[i]);
+        uint8* begin = rows->bytes.data() + rows->starts[i];
+        uint8* out = begin + skip_table_size(degree);
+        for(int k=0; k<degree; ++k){
+            if(k % COMPRESSED_BLOCK_SIZE != 0){
+                out = put_varint(row[k] - row[k-1], out);
+                continue;
+            }
+            int b = k/COMPRESSED_BLOCK_SIZE;
+            if(b > 0){
+                uint32 offset = static_cast<uint32>(out - begin);
+                memcpy(begin + sizeof(uint32)*(b-1), &offset, sizeof(uint32));
+            }
+            out = put_varint(row[k], out);
+        }
+    }
+}
+
+
+VertexIndex compressed_neighbor(const CompressedRows& rows, VertexIndex row, int degree, int k){
+    const uint8* in = block_start(rows.bytes.data() + rows.starts[row], degree, k/COMPRESSED_BLOCK_SIZE);
+    uint64 value = get_varint(in);
+    for(int j=k%COMPRESSED_BLOCK_SIZE; j>0; --j)
+        value += get_varint(in);
+    return static_cast<VertexIndex>(value);
+}
+
+
+int compressed_position(const CompressedRows& rows, VertexIndex row, int degree, VertexIndex neighbor){
+    if(degree == 0 || neighbor < 0)
+        return -1;
+    const uint8* begin = rows.bytes.data() + rows.starts[row];
+    uint64 target = neighbor;
+    // Number of blocks whose first neighbor is below target. The first
+    // occurrence of target is in the last of them, or starts the next one.
+    int lo = 0;
+    int hi = nb_blocks(degree);
+    while(lo < hi){
+        int mid = (lo + hi)/2;
+        const uint8* in = block_start(begin, degree, mid);
+        if(get_varint(in) < target)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    int b = std::max(0, lo - 1);
+    // Blocks are contiguous, the scan may go on in the next one.
+    const uint8* in = block_start(begin, degree, b);
+    uint64 value = 0;
+    for(int k=b*COMPRESSED_BLOCK_SIZE; k<degree; ++k){
+        uint64 raw = get_varint(in);
+        value = k % COMPRESSED_BLOCK_SIZE == 0 ? raw : value + raw;
+        if(value >= target)
+            return value == target ? k : -1;
+    }
+    return -1;
+}
+
+
+void decompress_row(const CompressedRows& rows, VertexIndex row, int degree, VertexIndex* out){
+    const uint8* in = block_start(rows.bytes.data() + rows.starts[row], degree, 0);
+    uint64 value = 0;
+    for(int k=0; k<degree; ++k){
+        uint64 raw = get_varint(in);
+        value = k % COMPRESSED_BLOCK_SIZE == 0 ? raw : value + raw;
+        out[k] = static_cast<VertexIndex>(value);
+    }
+}
+
+
+bool check_compressed_rows(const CompressedRows& rows, const std::vector<EdgeOffset>& offsets){
+    if(offsets.empty() || rows.starts.size() != offsets.size() || rows.starts[0] != 0
+       || rows.starts.back() != static_cast<EdgeOffset>(rows.bytes.size()))
+        return false;
+    VertexIndex nb_rows = static_cast<VertexIndex>(offsets.size()) - 1;
+    for(VertexIndex i=0; i<nb_rows; ++i){
+        if(rows.starts[i+1] < rows.starts[i] || offsets[i+1] - offsets[i] > std::numeric_limits<int>::max())
+            return false;
+        int degree = static_cast<int>(offsets[i+1] - offsets[i]);
+        const uint8* begin = rows.bytes.data() + rows.starts[i];
+        const uint8* end = rows.bytes.data() + rows.starts[i+1];
+        if(end - begin < skip_table_size(degree))
+            return false;
+        // Decodes the row as decompress_row does, checking that each block
+        // starts where the skip table says.
+        const uint8* in = begin + skip_table_size(degree);
+        for(int k=0; k<degree; ++k){
+            if(k > 0 && k % COMPRESSED_BLOCK_SIZE == 0){
+                uint32 offset;
+                memcpy(&offset, begin + sizeof(uint32)*(k/COMPRESSED_BLOCK_SIZE - 1), sizeof(uint32));
+                if(offset != static_cast<uint64>(in - begin))
+                    return false;
+            }
+            if(!skip_varint(in, end))
+                return false;
+        }
+    }
+    return true;
+}
+
+} // Namespace
@@ -0,0 +1,59 @@
+#ifndef COMPRESSED_ROWS_H
+#define COMPRESSED_ROWS_H
+
+#include <vector>
+
+#include "tensorflow/core/platform/types.h"
+#include "graph_index.h"
+
+using namespace tensorflow;
+
+namespace gseq{
+
+// Number of neighbors per block of a compressed row.
+const int COMPRESSED_BLOCK_SIZE = 32;
+
+
+// Sorted rows of vertex indices, delta encoded as varints (7 bits per byte,
+// the high bit set on every byte but the last). Row i takes the bytes
+// bytes[starts[i]:starts[i+1]].
+//
+// A row is cut into blocks of COMPRESSED_BLOCK_SIZE neighbors. The first
+// neighbor of a block is stored in full and the others as the difference
+// with the previous one. Rows of more than one block start with a skip
+// table: the uint32 byte offset, from the start of the row, of every block
+// but the first. Reading the k-th neighbor then decodes at most one block,
+// and looking a neighbor up is a binary search on the first neighbors of
+// the blocks followed by a scan of one block.
+//
+// Degrees are not stored, they are passed by the caller who has them in its
+// offsets.
+typedef struct CompressedRows {
+    std::vector<EdgeOffset> starts;
+    std::vector<uint8> bytes;
+} CompressedRows;
+
+
+// Encodes the rows idx[offsets[i]:offsets[i+1]], which must be sorted.
+void compress_rows(const std::vector<EdgeOffset>& offsets, const std::vector<VertexIndex>& idx,
+                   CompressedRows* rows);
+
+// k-th neighbor of row, which has degree neighbors.
+VertexIndex compressed_neighbor(const CompressedRows& rows, VertexIndex row, int degree, int k);
+
+// Position of the first occurrence of neighbor in row, or -1 if it is not
+// in the row.
+int compressed_position(const CompressedRows& rows, VertexIndex row, int degree, VertexIndex neighbor);
+
+// Writes the degree neighbors of row to out.
+void decompress_row(const CompressedRows& rows, VertexIndex row, int degree, VertexIndex* out);
+
+// Whether rows, whose degrees are given by the non-decreasing offsets, can
+// be decoded without reading out of bytes: starts are non-decreasing and
+// end at bytes.size(), the skip tables point to the blocks and every varint
+// ends within its row. Used on rows read back from a file.
+bool check_compressed_rows(const CompressedRows& rows, const std::vector<EdgeOffset>& offsets);
+
+} // Namespace
+
+#endif // COMPRESSED_ROWS_H
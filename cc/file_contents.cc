@@ -0,0 +1,20 @@
+#include "tensorflow/core/lib/core/errors.h"
+#include "file_contents.h"
+
+namespace gseq{
+
+Status FileContents::Open(Env* env, const string& filename){
+    region_.reset();
+    contents_.clear();
+    uint64 size;
+    TF_RETURN_IF_ERROR(env->GetFileSize(filename, &size));
+    if(size > 0){
+        Status status = env->NewReadOnlyMemoryRegionFromFile(filename, &region_);
+        if(!errors::IsUnimplemented(status))
+            return status;
+        region_.reset();
+    }
+    return ReadFileToString(env, filename, &contents_);
+}
+
+} // Namespace
@@ -0,0 +1,37 @@
+#ifndef FILE_CONTENTS_H
+#define FILE_CONTENTS_H
+
+#include <memory>
+#include <string>
+
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+
+using namespace tensorflow;
+
+namespace gseq{
+
+// Read-only contents of a file, mapped in memory when the file system
+// supports it. Files of file systems without memory regions (gs://,
+// hdfs://...) and empty files, which can't be mapped, are read into a
+// string instead.
+class FileContents {
+public:
+    Status Open(Env* env, const string& filename);
+
+    const char* data() const {
+        return region_ ? static_cast<const char*>(region_->data()) : contents_.data();
+    }
+
+    uint64 size() const {
+        return region_ ? region_->length() : contents_.size();
+    }
+
+private:
+    std::unique_ptr<ReadOnlyMemoryRegion> region_;
+    string contents_;
+};
+
+} // Namespace
+
+#endif // FILE_CONTENTS_H
@@ -0,0 +1,246 @@
+#include <algorithm>
+#include <utility>
+
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/util/work_sharder.h"
+#include "graph_builder.h"
+
+namespace gseq{
+
+VertexIndex GraphBuilder::InternVertex(StringPiece id){
+    uint64 hash = id_index_.Hash(id);
+    VertexIndex vertex = id_index_.Find(ids_, id, hash);
+    if(vertex < 0){
+        vertex = ids_.Add(id);
+        id_index_.Insert(ids_, vertex, hash);
+    }
+    return vertex;
+}
+
+
+VertexIndex GraphBuilder::AddIntVertex(int64 id){
+    int_ids_.push_back(id);
+    return static_cast<VertexIndex>(int_ids_.size()) - 1;
+}
+
+
+int64 GraphBuilder::AddEdge(VertexIndex source, VertexIndex target, float weight){
+    sources_.push_back(source);
+    targets_.push_back(target);
+    if(has_weights_)
+        weights_.push_back(weight);
+    return static_cast<int64>(sources_.size()) - 1;
+}
+
+
+void GraphBuilder::SetEdgeWeight(int64 edge, float weight){
+    if(has_weights_)
+        weights_[edge] = weight;
+}
+
+
+Status GraphBuilder::Finalize(CSRGraph* csr, const string& order, Tensor* ids,
+                              thread::ThreadPool* workers, int num_threads){
+    VertexIndex nb_vertices = NumVertices();
+    BuildCSR(csr, workers, num_threads);
+    std::vector<VertexIndex> permutation;
+    TF_RETURN_IF_ERROR(vertex_order(order, *csr, &permutation));
+    if(!permutation.empty())
+        permute_csr(permutation, csr, workers, num_threads);
+    auto vertex = [&permutation](VertexIndex i){
+        return permutation.empty() ? i : permutation[i];
+    };
+    if(integer_ids_){
+        auto flat = ids->flat<int64>();
+        for(VertexIndex i=0; i<nb_vertices; ++i)
+            flat(i) = int_ids_[vertex(i)];
+        std::vector<int64>().swap(int_ids_);
+        return Status::OK();
+    }
+    id_index_.Clear();
+    auto flat = ids->flat<string>();
+    for(VertexIndex i=0; i<nb_vertices; ++i){
+        StringPiece id = ids_[vertex(i)];
+        flat(i).assign(id.data(), id.size());
+    }
+    ids_.Clear();
+    return Status::OK();
+}
+
+
+void GraphBuilder::BuildCSR(CSRGraph* csr, thread::ThreadPool* workers, int num_threads){
+    VertexIndex nb_vertices = NumVertices();
+    int64 nb_edges = NumEdges();
+    bool both_ways = !directed_;
+
+    // Counting sort of the edges by row: offsets[i+1] first holds the degree
+    // of i, then the prefix sums give the start of each row.
+    csr->offsets.assign(nb_vertices+1, 0);
+    for(int64 e=0; e<nb_edges; ++e){
+        ++csr->offsets[sources_[e]+1];
+        if(both_ways && sources_[e] != targets_[e])
+            ++csr->offsets[targets_[e]+1];
+    }
+    for(VertexIndex i=0; i<nb_vertices; ++i)
+        csr->offsets[i+1] += csr->offsets[i];
+
+    EdgeOffset nb_entries = csr->offsets[nb_vertices];
+    csr->neighbors.resize(nb_entries);
+    csr->weights.resize(has_weights_ ? nb_entries : 0);
+    std::vector<EdgeOffset> cursor(csr->offsets.begin(), csr->offsets.end() - 1);
+    auto place = [this, csr, &cursor](VertexIndex from, VertexIndex to, int64 e){
+        EdgeOffset position = cursor[from]++;
+        csr->neighbors[position] = to;
+        if(has_weights_)
+            csr->weights[position] = weights_[e];
+    };
+    for(int64 e=0; e<nb_edges; ++e){
+        place(sources_[e], targets_[e], e);
+        if(both_ways && sources_[e] != targets_[e])
+            place(targets_[e], sources_[e], e);
+    }
+    std::vector<EdgeOffset>().swap(cursor);
+    std::vector<VertexIndex>().swap(sources_);
+    std::vector<VertexIndex>().swap(targets_);
+    std::vector<float>().swap(weights_);
+
+    sort_rows(csr, workers, num_threads);
+}
+
+void sort_rows(CSRGraph* csr, thread::ThreadPool* workers, int num_threads){
+    VertexIndex nb_vertices = static_cast<VertexIndex>(csr->offsets.size()) - 1;
+    bool has_weights = !csr->weights.empty();
+    auto sort_range = [csr, has_weights](int64 start, int64 end){
+        std::vector<std::pair<VertexIndex, float>> row;
+        for(int64 i=start; i<end; ++i){
+            VertexIndex* begin = csr->neighbors.data() + csr->offsets[i];
+            EdgeOffset degree = csr->offsets[i+1] - csr->offsets[i];
+            if(!has_weights){
+                std::sort(begin, begin + degree);
+                continue;
+            }
+            float* weights = csr->weights.data() + csr->offsets[i];
+            row.resize(degree);
+            for(EdgeOffset k=0; k<degree; ++k)
+                row[k] = std::make_pair(begin[k], weights[k]);
+            std::sort(row.begin(), row.end());
+            for(EdgeOffset k=0; k<degree; ++k){
+                begin[k] = row[k].first;
+                weights[k] = row[k].second;
+            }
+        }
+    };
+    if(workers != nullptr && num_threads > 1 && nb_vertices > 0){
+        int64 cost = std::max<int64>(1, 10*static_cast<int64>(csr->neighbors.size())/nb_vertices);
+        Shard(num_threads, workers, nb_vertices, cost, sort_range);
+    }
+    else{
+        sort_range(0, nb_vertices);
+    }
+}
+
+
+std::vector<VertexIndex> degree_order(const CSRGraph& csr){
+    VertexIndex nb_vertices = static_cast<VertexIndex>(csr.offsets.size()) - 1;
+    std::vector<VertexIndex> order(nb_vertices);
+    for(VertexIndex i=0; i<nb_vertices; ++i)
+        order[i] = i;
+    auto degree = [&csr](VertexIndex node){
+        return csr.offsets[node+1] - csr.offsets[node];
+    };
+    std::stable_sort(order.begin(), order.end(), [&degree](VertexIndex a, VertexIndex b){
+        return degree(a) > degree(b);
+    });
+    return order;
+}
+
+
+std::vector<VertexIndex> rcm_order(const CSRGraph& csr){
+    VertexIndex nb_vertices = static_cast<VertexIndex>(csr.offsets.size()) - 1;
+    auto degree = [&csr](VertexIndex node){
+        return csr.offsets[node+1] - csr.offsets[node];
+    };
+    auto by_degree = [&degree](VertexIndex a, VertexIndex b){
+        return degree(a) < degree(b);
+    };
+    // Every component is searched from its lowest degree vertex, so the
+    // candidate starts are taken by increasing degree.
+    std::vector<VertexIndex> starts(nb_vertices);
+    for(VertexIndex i=0; i<nb_vertices; ++i)
+        starts[i] = i;
+    std::stable_sort(starts.begin(), starts.end(), by_degree);
+
+    std::vector<VertexIndex> order;
+    order.reserve(nb_vertices);
+    std::vector<bool> visited(nb_vertices, false);
+    for(VertexIndex start : starts){
+        if(visited[start])
+            continue;
+        visited[start] = true;
+        size_t head = order.size();
+        order.push_back(start);
+        // order[head:] is the queue of the breadth first search.
+        for(; head<order.size(); ++head){
+            VertexIndex node = order[head];
+            size_t first_child = order.size();
+            for(EdgeOffset k=csr.offsets[node]; k<csr.offsets[node+1]; ++k){
+                VertexIndex neighbor = csr.neighbors[k];
+                if(!visited[neighbor]){
+                    visited[neighbor] = true;
+                    order.push_back(neighbor);
+                }
+            }
+            std::stable_sort(order.begin() + first_child, order.end(), by_degree);
+        }
+    }
+    std::reverse(order.begin(), order.end());
+    return order;
+}
+
+
+void permute_csr(const std::vector<VertexIndex>& order, CSRGraph* csr,
+                 thread::ThreadPool* workers, int num_threads){
+    VertexIndex nb_vertices = static_cast<VertexIndex>(order.size());
+    bool has_weights = !csr->weights.empty();
+    std::vector<VertexIndex> new_id(nb_vertices);
+    for(VertexIndex i=0; i<nb_vertices; ++i)
+        new_id[order[i]] = i;
+
+    CSRGraph permuted;
+    permuted.offsets.resize(nb_vertices+1);
+    permuted.offsets[0] = 0;
+    for(VertexIndex i=0; i<nb_vertices; ++i)
+        permuted.offsets[i+1] = permuted.offsets[i] + csr->offsets[order[i]+1] - csr->offsets[order[i]];
+    permuted.neighbors.resize(csr->neighbors.size());
+    permuted.weights.resize(csr->weights.size());
+    for(VertexIndex i=0; i<nb_vertices; ++i){
+        EdgeOffset position = permuted.offsets[i];
+        for(EdgeOffset k=csr->offsets[order[i]]; k<csr->offsets[order[i]+1]; ++k, ++position){
+            permuted.neighbors[position] = new_id[csr->neighbors[k]];
+            if(has_weights)
+                permuted.weights[position] = csr->weights[k];
+        }
+    }
+    sort_rows(&permuted, workers, num_threads);
+    std::swap(*csr, permuted);
+}
+
+
+bool is_vertex_order(const string& order){
+    return order == "none" || order == "degree" || order == "rcm";
+}
+
+
+Status vertex_order(const string& name, const CSRGraph& csr, std::vector<VertexIndex>* order){
+    if(!is_vertex_order(name))
+        return errors::InvalidArgument("Unknown vertex order '", name, "', expected none, degree or rcm");
+    if(name == "degree")
+        *order = degree_order(csr);
+    else if(name == "rcm")
+        *order = rcm_order(csr);
+    else
+        order->clear();
+    return Status::OK();
+}
+
+} // Namespace
@@ -0,0 +1,110 @@
+#ifndef GRAPH_BUILDER_H
+#define GRAPH_BUILDER_H
+
+#include <string>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/lib/core/threadpool.h"
+#include "tensorflow/core/platform/types.h"
+#include "graph_index.h"
+#include "string_interner.h"
+
+using namespace tensorflow;
+
+namespace gseq{
+
+// Adjacency of a graph in compressed sparse row layout. The neighbors of
+// node i are neighbors[offsets[i]:offsets[i+1]], sorted by id, and weights
+// is parallel to neighbors for weighted graphs (empty otherwise).
+struct CSRGraph {
+    std::vector<EdgeOffset> offsets;
+    std::vector<VertexIndex> neighbors;
+    std::vector<float> weights;
+};
+
+
+// Collects the vertices and edges produced by the graph readers and turns
+// them into a CSRGraph. Edges are only buffered as (source, target, weight)
+// arrays while reading; Finalize counts the degrees, places every edge in
+// its row with a counting sort and sorts the rows.
+//
+// Vertices are numbered in order of InternVertex calls with a new id, the
+// intern table on the ids deduplicating them. Ids are kept in a StringArena
+// until Finalize. Parallel edges are kept, and in undirected graphs a self
+// loop is stored once in the row of its vertex.
+//
+// With integer_ids, vertex ids are int64 numbers, added with AddIntVertex
+// by the readers (which deduplicate them), and no string is allocated.
+class GraphBuilder {
+public:
+    GraphBuilder(bool directed, bool has_weights, bool integer_ids = false)
+        : directed_(directed), has_weights_(has_weights), integer_ids_(integer_ids) { }
+
+    bool IsDirected() const {return directed_;}
+    bool HasWeights() const {return has_weights_;}
+    bool IntegerIds() const {return integer_ids_;}
+
+    // Vertex of id, added if no vertex was interned with that id yet.
+    VertexIndex InternVertex(StringPiece id);
+    VertexIndex AddIntVertex(int64 id);
+
+    // Returns the index of the edge, to set its weight later on.
+    int64 AddEdge(VertexIndex source, VertexIndex target, float weight = 1.);
+    void SetEdgeWeight(int64 edge, float weight);
+
+    VertexIndex NumVertices() const {
+        return integer_ids_ ? static_cast<VertexIndex>(int_ids_.size()) : ids_.size();
+    }
+    int64 NumEdges() const {return static_cast<int64>(sources_.size());}
+
+    // Builds csr renumbered to the named vertex order (see vertex_order) and
+    // writes the vertex ids to ids, a string or int64 tensor of NumVertices()
+    // elements, straight from the intern table: the ids are never copied
+    // into an intermediate vector. The edge buffer is released on the way,
+    // the builder is empty afterwards. Rows are sorted on workers when
+    // given.
+    Status Finalize(CSRGraph* csr, const string& order, Tensor* ids,
+                    thread::ThreadPool* workers = nullptr, int num_threads = 1);
+
+private:
+    void BuildCSR(CSRGraph* csr, thread::ThreadPool* workers, int num_threads);
+
+    bool directed_;
+    bool has_weights_;
+    bool integer_ids_;
+    StringArena ids_;
+    StringInterner<StringArena> id_index_;
+    std::vector<int64> int_ids_;
+    std::vector<VertexIndex> sources_;
+    std::vector<VertexIndex> targets_;
+    std::vector<float> weights_;
+};
+
+// Sorts every row of csr by neighbor id, on workers when given.
+void sort_rows(CSRGraph* csr, thread::ThreadPool* workers = nullptr, int num_threads = 1);
+
+// Vertex orders for permute_csr: order[i] is the vertex that gets index i.
+// degree_order puts the vertices by decreasing degree, so that the hubs
+// most walk steps go through share cache lines and pages. rcm_order is the
+// reverse Cuthill-McKee order, a breadth first search that gives adjacent
+// vertices close indices.
+std::vector<VertexIndex> degree_order(const CSRGraph& csr);
+std::vector<VertexIndex> rcm_order(const CSRGraph& csr);
+
+// Renumbers the vertices of csr to order.
+void permute_csr(const std::vector<VertexIndex>& order, CSRGraph* csr,
+                 thread::ThreadPool* workers = nullptr, int num_threads = 1);
+
+// True for the orders vertex_order knows: none, degree and rcm.
+bool is_vertex_order(const string& order);
+
+// Vertex order of csr named name, empty for none. Finalize renumbers the
+// graph to it before the alias tables are built on top of it.
+Status vertex_order(const string& name, const CSRGraph& csr, std::vector<VertexIndex>* order);
+
+} // Namespace
+
+#endif // GRAPH_BUILDER_H
@@ -0,0 +1,37 @@
+#ifndef GRAPH_INDEX_H
+#define GRAPH_INDEX_H
+
+#include "tensorflow/core/framework/types.h"
+#include "tensorflow/core/platform/types.h"
+
+using namespace tensorflow;
+
+namespace gseq{
+
+// Integer types of the graph structures.
+//
+// EdgeOffset indexes the edges of the whole graph: the row offsets of the
+// adjacency and of the alias tables. It is always 64 bits, so that graphs
+// with more than 2^31 edges load.
+//
+// VertexIndex numbers the vertices in the adjacency, the walks and the
+// examples. It is int32 unless the library is built with
+// -DGSEQ_INT64_VERTICES, which lifts the limit of 2^31 vertices at the cost
+// of twice the memory for the adjacency and the walks. It stays signed as
+// -1 marks missing nodes (see subsample).
+//
+// Positions inside a single row or alias table, i.e. degrees, stay int32.
+#ifdef GSEQ_INT64_VERTICES
+typedef int64 VertexIndex;
+#define GSEQ_VERTEX_INDEX_TYPE "int64"
+#else
+typedef int32 VertexIndex;
+#define GSEQ_VERTEX_INDEX_TYPE "int32"
+#endif
+typedef int64 EdgeOffset;
+
+const DataType DT_VERTEX_INDEX = DataTypeToEnum<VertexIndex>::value;
+
+} // Namespace
+
+#endif // GRAPH_INDEX_H
@@ -1,106 +1,551 @@
+#include <cmath>
 #include <iostream>
+#include <limits>
 #include "graph_kernel_base.h"
 
 namespace gseq{
 
-std::vector<Alias>* BaseGraphKernel::getNodeAlias(){return &node_alias_;}
+AliasTable* BaseGraphKernel::getNodeAlias(){return &node_alias_;}
 
-std::vector<int32>* BaseGraphKernel::getValidNodes(){return &valid_nodes_;}
+std::vector<VertexIndex>* BaseGraphKernel::getValidNodes(){return &valid_nodes_;}
 
 const std::string& BaseGraphKernel::getWeightAttrName(){return weight_attr_name_;}
 
+const std::string& BaseGraphKernel::getReorder(){return reorder_;}
+
+bool BaseGraphKernel::IntegerIds(){return id_type_ == DT_INT64;}
+
+bool BaseGraphKernel::CompressAdjacency(){return compress_adjacency_;}
+
 Tensor& BaseGraphKernel::getNodeId(){return node_id_;}
 
+int BaseGraphKernel::getNumThreads(){return num_threads_;}
+
+thread::ThreadPool* BaseGraphKernel::getWorkers(){return workers_;}
+
 
 BaseGraphKernel::BaseGraphKernel(OpKernelConstruction* ctx)
       : OpKernel(ctx){
 
     OP_REQUIRES_OK(ctx, ctx->GetAttr("size", &seq_size_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("batchsize", &batchsize_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("num_batches", &num_batches_));
+    OP_REQUIRES(ctx, batchsize_ > 0 && num_batches_ > 0,
+                errors::InvalidArgument("batchsize and num_batches must be positive"));
+    walks_per_call_ = batchsize_*num_batches_;
     OP_REQUIRES_OK(ctx, ctx->GetAttr("directed", &directed_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("weights_attribute", &weight_attr_name_));
     OP_REQUIRES_OK(ctx, ctx->GetAttr("has_weights", &has_weights_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("snapshot", &snapshot_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("id_type", &id_type_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("reorder", &reorder_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("compress_adjacency", &compress_adjacency_));
+    OP_REQUIRES(ctx, is_vertex_order(reorder_),
+                errors::InvalidArgument("reorder must be none, degree or rcm, got '", reorder_, "'"));
     auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
     num_threads_ = worker_threads.num_threads;
-    guarded_philox_.Init(0, 0);
+    workers_ = worker_threads.workers;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("seed", &seed_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("seed2", &seed2_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("subsample", &subsample_));
+    OP_REQUIRES(ctx, subsample_ >= 0, errors::InvalidArgument("subsample can't be negative"));
+    // Like the random ops, seeds of 0 mean non deterministic walks.
+    if(seed_ == 0 && seed2_ == 0){
+        seed_ = random::New64();
+        seed2_ = random::New64();
+    }
+    random::PhiloxRandom seeds(seed_, seed2_);
+    random::PhiloxRandom::ResultType mixed = seeds();
+    walk_key_[0] = mixed[0];
+    walk_key_[1] = mixed[1];
+    walk_queue_.reset(new WalkQueue<WalkBatch>(std::max<int64>(2, PRECOMPUTE/walks_per_call_)));
+}
+
+
+BaseGraphKernel::~BaseGraphKernel(){
+    StopProducer();
 }
 
 
 void BaseGraphKernel::Compute(OpKernelContext* ctx) {
-    Tensor epoch(DT_INT32, TensorShape({}));
-    Tensor total(DT_INT32, TensorShape({}));
-    Tensor nb_valid_nodes(DT_INT32, TensorShape({}));
-    Tensor walk(DT_INT32, TensorShape({batchsize_, seq_size_}));
+    OP_REQUIRES(ctx, !valid_nodes_.empty(),
+                errors::FailedPrecondition("The graph has no node with outgoing edges"));
+    WalkBatch batch;
+    NextBatch(&batch);
+    ctx->set_output(0, node_id_);
+    ctx->set_output(1, batch.walks);
+    SetCounterOutputs(ctx, 2);
+
+}
+
+
+void BaseGraphKernel::SetCounterOutputs(OpKernelContext* ctx, int first_output){
+    Tensor epoch(DT_INT64, TensorShape({}));
+    Tensor total(DT_INT64, TensorShape({}));
+    Tensor nb_valid_nodes(DT_INT64, TensorShape({}));
+    int64 nb_generated = total_seq_generated_.fetch_add(walks_per_call_) + walks_per_call_;
+    epoch.scalar<int64>()() = nb_generated/static_cast<int64>(valid_nodes_.size());
+    total.scalar<int64>()() = nb_generated;
+    nb_valid_nodes.scalar<int64>()() = valid_nodes_.size();
+    ctx->set_output(first_output, epoch);
+    ctx->set_output(first_output+1, total);
+    ctx->set_output(first_output+2, nb_valid_nodes);
+}
+
+
+void BaseGraphKernel::NextBatch(WalkBatch* batch){
+    if(!walk_queue_->TryPop(batch)){
+        // Only sleeps when the producer falls behind.
+        mutex_lock l(mu_);
+        ++waiting_consumers_;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!walk_queue_->TryPop(batch))
+            walks_ready_.wait(l);
+        --waiting_consumers_;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(producer_waiting_.load()){
+        mutex_lock l(mu_);
+        slots_free_.notify_one();
+    }
+}
+
+
+void BaseGraphKernel::StartProducer(Env* env){
+    // No queue if the constructor failed before creating it.
+    if(!walk_queue_ || valid_nodes_.empty())
+        return;
+    SetupSubsampling();
+    producer_.reset(env->StartThread(ThreadOptions(), "graph_walk_producer",
+                                     [this](){ProduceWalks();}));
+}
+
+
+void BaseGraphKernel::StopProducer(){
     {
         mutex_lock l(mu_);
-        for(int i=0; i<batchsize_;i++){
-            NextWalk(ctx, walk, i);
-        }
-        epoch.scalar<int32>()() = current_epoch_;
-        total.scalar<int32>()() = total_seq_generated_;
+        stop_producer_ = true;
     }
-    nb_valid_nodes.scalar<int32>()() = valid_nodes_.size();
-    ctx->set_output(0, node_id_);
-    ctx->set_output(1, walk);
-    ctx->set_output(2, epoch);
-    ctx->set_output(3, total);
-    ctx->set_output(4, nb_valid_nodes);
+    slots_free_.notify_all();
+    // Joins the thread.
+    producer_.reset();
+}
 
+
+bool BaseGraphKernel::PushBatch(WalkBatch& batch){
+    if(!walk_queue_->TryPush(batch)){
+        mutex_lock l(mu_);
+        producer_waiting_ = true;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        while(!walk_queue_->TryPush(batch)){
+            if(stop_producer_){
+                producer_waiting_ = false;
+                return false;
+            }
+            slots_free_.wait(l);
+        }
+        producer_waiting_ = false;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(waiting_consumers_.load() > 0){
+        mutex_lock l(mu_);
+        walks_ready_.notify_all();
+    }
+    return true;
 }
 
 
-void BaseGraphKernel::NextWalk(OpKernelContext* ctx, Tensor& walk, int w_idx) EXCLUSIVE_LOCKS_REQUIRED(mu_) {
-    int N = valid_nodes_.size();
-    int available = (write_walk_idx + PRECOMPUTE - cur_walk_idx) % PRECOMPUTE;
-    if(available <= LOW_WATER_MARK){
-        int start = write_walk_idx;
-        int end = cur_walk_idx-1;
-        if(end <= start)
-            end += PRECOMPUTE;
-            auto fn = [this](int64 s, int64 e){
-            PrecomputeWalks(write_walk_idx, s, e);
+void BaseGraphKernel::ProduceWalks(){
+    // REFILL_SIZE walks per thread, leaving at least half of the queue to
+    // Compute.
+    int max_batches = std::max<int>(1, walk_queue_->capacity()/2);
+    int nb_batches = std::min<int64>(max_batches, std::max<int64>(1, int64(REFILL_SIZE)*num_threads_/walks_per_call_));
+    int64 nb_walks = nb_batches*walks_per_call_;
+    int64 walk_cost = int64(seq_size_)*StepCost();
+    while(!stop_producer_){
+        // Every batch is a tensor of its own, handed over to Compute
+        // without copies.
+        int64 first_walk = produced_walks_;
+        std::vector<WalkBatch> batches(nb_batches);
+        for(int b=0; b<nb_batches; ++b){
+            batches[b].walks = Tensor(DT_VERTEX_INDEX, TensorShape({walks_per_call_, seq_size_}));
+            batches[b].first_walk = first_walk + b*walks_per_call_;
+        }
+        auto fn = [this, &batches, first_walk](int64 s, int64 e){
+            PrecomputeWalks(&batches, first_walk, s, e);
         };
+        // Shards write disjoint rows, and walks do not depend on the shard
+        // layout (see WalkGenerator).
+        Shard(num_threads_, workers_, nb_walks, walk_cost, fn);
+        produced_walks_ += nb_walks;
+
+        for(auto& batch : batches){
+            if(!PushBatch(batch))
+                return;
+        }
+    }
+}
+
 
-        auto worker_threads = *(ctx->device()->tensorflow_cpu_worker_threads());
-        // worker_threads.num_threads
-        #ifndef NO_SHARDER
-        Shard(4, worker_threads.workers,
-            end-start, 50000,
-            fn);
-        #else
-        PrecomputeWalks(write_walk_idx, start, end);
-        #endif
-        write_walk_idx+=(end-start);
-        write_walk_idx%=PRECOMPUTE;
-        current_node_idx_ += (end-start);
-        current_node_idx_ %= N;
-
-    }
-
-    auto w = walk.matrix<int32>();
-    w.chip<0>(w_idx) = precomputed_walks.matrix<int32>().chip<0>(cur_walk_idx);
-    cur_walk_idx++;
-    total_seq_generated_++;
-    cur_walk_idx%=PRECOMPUTE;
-    current_epoch_ = total_seq_generated_/N;
-}
-
-
-void BaseGraphKernel::PrecomputeWalks(int write_idx, int start_idx, int end_idx){
-    int N = valid_nodes_.size();
-    int reserve = seq_size_;
-    if(HasWeights())
-        reserve *= 2;
-    random::PhiloxRandom phi = guarded_philox_.ReserveSamples128(1*seq_size_);  // thread safe
+void BaseGraphKernel::PrecomputeWalks(std::vector<WalkBatch>* batches, int64 first_walk, int64 start_idx, int64 end_idx){
+    int64 N = valid_nodes_.size();
+    random::PhiloxRandom phis[WALK_GROUP_SIZE];
+    std::vector<random::SimplePhilox> gens;
+    gens.reserve(WALK_GROUP_SIZE);
+    VertexIndex* walks[WALK_GROUP_SIZE];
+    for(int64 group=start_idx; group<end_idx; group+=WALK_GROUP_SIZE){
+        int nb_walks = std::min<int64>(WALK_GROUP_SIZE, end_idx - group);
+        gens.clear();
+        for(int w=0; w<nb_walks; ++w){
+            int64 i = group + w;
+            Tensor& batch = (*batches)[i/walks_per_call_].walks;
+            walks[w] = batch.flat<VertexIndex>().data() + (i%walks_per_call_)*seq_size_;
+            walks[w][0] = valid_nodes_[(first_walk+i)%N];
+            phis[w] = WalkGenerator(first_walk + i);
+            gens.emplace_back(&phis[w]);
+        }
+        PrecomputeWalkGroup(walks, gens.data(), nb_walks);
+        if(subsample_ > 0){
+            for(int w=0; w<nb_walks; ++w)
+                SubsampleWalk(walks[w], first_walk + group + w);
+        }
+    }
+}
+
+
+void BaseGraphKernel::SetupSubsampling(){
+    if(subsample_ <= 0)
+        return;
+    // Nodes are visited about as often as their degree, which stands for
+    // the word count of word2vec.
+    VertexIndex nb_vertices = static_cast<VertexIndex>(node_alias_.offsets.size()) - 1;
+    double total = node_alias_.offsets.back();
+    keep_proba_.resize(nb_vertices);
+    for(VertexIndex i=0; i<nb_vertices; ++i){
+        double frequency = degree(node_alias_, i)/total;
+        double keep = 1.;
+        if(frequency > 0)
+            keep = (std::sqrt(frequency/subsample_) + 1)*subsample_/frequency;
+        keep_proba_[i] = static_cast<float>(std::min(1., keep));
+    }
+}
+
+
+void BaseGraphKernel::SubsampleWalk(VertexIndex* walk, int64 walk_idx){
+    random::PhiloxRandom phi = WalkGenerator(walk_idx, SUBSAMPLE_STREAM_OFFSET);
     random::SimplePhilox gen(&phi);
-    for(int i=start_idx; i<end_idx; i++){
-        PrecomputeWalk((write_idx+i)%PRECOMPUTE, valid_nodes_[(current_node_idx_+i)%N], gen);
+    int kept = 0;
+    for(int k=0; k<seq_size_; ++k){
+        VertexIndex node = walk[k];
+        if(node >= 0 && gen.RandFloat() < keep_proba_[node])
+            walk[kept++] = node;
+    }
+    for(int k=kept; k<seq_size_; ++k)
+        walk[k] = -1;
+}
+
+
+int64 BaseGraphKernel::StepCost(){
+    // Rough cycles per step: a uniform draw, or an alias draw that touches
+    // two more arrays.
+    return HasWeights() ? 60 : 30;
+}
+
+
+random::PhiloxRandom BaseGraphKernel::WalkGenerator(int64 walk, uint64 offset){
+    random::PhiloxRandom::ResultType counter;
+    counter[0] = 0;
+    counter[1] = 0;
+    counter[2] = static_cast<uint32>(walk);
+    counter[3] = static_cast<uint32>(static_cast<uint64>(walk) >> 32);
+    random::PhiloxRandom phi(counter, walk_key_);
+    phi.Skip(offset);
+    return phi;
+}
+
+
+Status BaseGraphKernel::LoadOrBuildGraph(Env* env, const string& filename){
+    if(!snapshot_.empty()){
+        FileStatistics stat;
+        TF_RETURN_IF_ERROR(env->Stat(filename, &stat));
+        snapshot_source_ = strings::StrCat(filename, " size=", stat.length, " mtime=", stat.mtime_nsec);
+    }
+    if(!snapshot_.empty() && env->FileExists(snapshot_).ok()){
+        SnapshotReader reader;
+        TF_RETURN_IF_ERROR(reader.Open(env, snapshot_));
+        TF_RETURN_IF_ERROR(ReadSnapshot(&reader));
+        cout << "loaded graph snapshot " << snapshot_ << endl;
+        return Status::OK();
+    }
+    TF_RETURN_IF_ERROR(BuildGraph(env, filename));
+    if(snapshot_.empty())
+        return Status::OK();
+    SnapshotWriter writer;
+    TF_RETURN_IF_ERROR(writer.Open(env, snapshot_));
+    TF_RETURN_IF_ERROR(WriteSnapshot(&writer));
+    return writer.Close();
+}
+
+
+string BaseGraphKernel::SnapshotParameters(){
+    return strings::StrCat("has_weights=", static_cast<int>(has_weights_),
+                           " directed=", static_cast<int>(directed_),
+                           " reorder=", reorder_,
+                           " integer_ids=", static_cast<int>(IntegerIds()),
+                           " vertex_index_bits=", 8*sizeof(VertexIndex),
+                           " compress_adjacency=", static_cast<int>(compress_adjacency_),
+                           " source=", snapshot_source_);
+}
+
+
+Status BaseGraphKernel::WriteSnapshot(SnapshotWriter* writer){
+    string parameters = SnapshotParameters();
+    TF_RETURN_IF_ERROR(writer->WriteBytes(parameters.data(), parameters.size()));
+    if(IntegerIds())
+        TF_RETURN_IF_ERROR(writer->WriteInt64s(node_id_));
+    else
+        TF_RETURN_IF_ERROR(writer->WriteStrings(node_id_));
+    TF_RETURN_IF_ERROR(writer->WriteArray(valid_nodes_));
+    TF_RETURN_IF_ERROR(writer->WriteArray(node_alias_.offsets));
+    TF_RETURN_IF_ERROR(writer->WriteArray(node_alias_.idx));
+    TF_RETURN_IF_ERROR(writer->WriteArray(node_alias_.probas));
+    TF_RETURN_IF_ERROR(writer->WriteArray(node_alias_.aliases));
+    TF_RETURN_IF_ERROR(writer->WriteArray(node_alias_.compressed.starts));
+    return writer->WriteArray(node_alias_.compressed.bytes);
+}
+
+
+Status BaseGraphKernel::ReadSnapshot(SnapshotReader* reader){
+    const char* data;
+    uint64 size;
+    TF_RETURN_IF_ERROR(reader->ReadBytes(&data, &size));
+    string parameters = SnapshotParameters();
+    if(string(data, size) != parameters)
+        return errors::InvalidArgument("Snapshot ", snapshot_, " was built with parameters '",
+                                       string(data, size), "' but the op has '", parameters, "'");
+    if(IntegerIds())
+        TF_RETURN_IF_ERROR(reader->ReadInt64s(&node_id_));
+    else
+        TF_RETURN_IF_ERROR(reader->ReadStrings(&node_id_));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&valid_nodes_));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&node_alias_.offsets));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&node_alias_.idx));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&node_alias_.probas));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&node_alias_.aliases));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&node_alias_.compressed.starts));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&node_alias_.compressed.bytes));
+    return CheckSnapshot();
+}
+
+
+Status BaseGraphKernel::CheckSnapshot(){
+    const AliasTable& table = node_alias_;
+    VertexIndex nb_vertices = static_cast<VertexIndex>(node_id_.NumElements());
+    if(table.offsets.size() != static_cast<size_t>(nb_vertices) + 1 || table.offsets[0] != 0)
+        return errors::DataLoss("Snapshot ", snapshot_, " has ", table.offsets.size(),
+                                " offsets for ", nb_vertices, " nodes");
+    EdgeOffset nb_edges = table.offsets.back();
+    for(VertexIndex i=0; i<nb_vertices; ++i){
+        if(table.offsets[i+1] < table.offsets[i])
+            return errors::DataLoss("Snapshot ", snapshot_, " has decreasing offsets");
+    }
+    if(is_compressed(table)){
+        if(!table.idx.empty() || !check_compressed_rows(table.compressed, table.offsets))
+            return errors::DataLoss("Snapshot ", snapshot_, " has inconsistent compressed rows");
+    }
+    else if(table.idx.size() != static_cast<size_t>(nb_edges) || !table.compressed.bytes.empty())
+        return errors::DataLoss("Snapshot ", snapshot_, " has ", table.idx.size(),
+                                " neighbors for ", nb_edges, " edges");
+    std::vector<VertexIndex> row;
+    for(VertexIndex i=0; i<nb_vertices; ++i){
+        int d = degree(table, i);
+        const VertexIndex* neighbors = table.idx.data() + table.offsets[i];
+        if(is_compressed(table)){
+            row.resize(d);
+            decompress_row(table.compressed, i, d, row.data());
+            neighbors = row.data();
+        }
+        for(int k=0; k<d; ++k){
+            if(neighbors[k] < 0 || neighbors[k] >= nb_vertices)
+                return errors::DataLoss("Snapshot ", snapshot_, " has neighbor ", neighbors[k], " out of range");
+        }
+    }
+    if(table.probas.size() != table.aliases.size()
+       || (!table.probas.empty() && table.probas.size() != static_cast<size_t>(nb_edges)))
+        return errors::DataLoss("Snapshot ", snapshot_, " has ", table.probas.size(), " probabilities and ",
+                                table.aliases.size(), " aliases for ", nb_edges, " edges");
+    for(VertexIndex i=0; i<nb_vertices && !table.aliases.empty(); ++i){
+        int d = degree(table, i);
+        for(EdgeOffset e=table.offsets[i]; e<table.offsets[i+1]; ++e){
+            if(table.aliases[e] < 0 || table.aliases[e] >= d)
+                return errors::DataLoss("Snapshot ", snapshot_, " has alias ", table.aliases[e], " out of range");
+        }
+    }
+    for(VertexIndex v : valid_nodes_){
+        if(v < 0 || v >= nb_vertices || degree(table, v) == 0)
+            return errors::DataLoss("Snapshot ", snapshot_, " has invalid node ", v);
     }
+    return Status::OK();
 }
 
 
-void BaseGraphKernel::InitNodeId(int nb_vertices){
-    node_id_ = Tensor(DT_STRING, TensorShape({nb_vertices}));
+void BaseGraphKernel::InitNodeId(VertexIndex nb_vertices){
+    node_id_ = Tensor(id_type_, TensorShape({nb_vertices}));
+}
+
+
+void setup_node_alias(const CSRGraph& graph, AliasTable& node_alias, std::vector<VertexIndex>& valid_nodes,
+                      bool has_weights, bool compress){
+    VertexIndex nb_vertices = static_cast<VertexIndex>(graph.offsets.size()) - 1;
+    node_alias.offsets = graph.offsets;
+    if(compress)
+        compress_rows(graph.offsets, graph.neighbors, &node_alias.compressed);
+    else
+        node_alias.idx = graph.neighbors;
+    if(has_weights){
+        node_alias.probas = graph.weights;
+        node_alias.aliases.resize(graph.weights.size());
+    }
+    for(VertexIndex i=0; i<nb_vertices; ++i){
+        EdgeOffset offset = graph.offsets[i];
+        int nb_neighbors = static_cast<int>(graph.offsets[i+1] - offset);
+        if(nb_neighbors == 0)
+            continue;
+        valid_nodes.push_back(i);
+        if(has_weights){
+            float sum_weights = 0;
+            for(int k=0; k<nb_neighbors; ++k)
+                sum_weights += graph.weights[offset+k];
+            setup_alias_vectors(&node_alias.probas[offset], &node_alias.aliases[offset], nb_neighbors, sum_weights);
+        }
+    }
+}
+
+
+bool edge_alias_fits(const std::vector<EdgeOffset>& offsets, int64 memory_budget){
+    if(memory_budget < 0)
+        return true;
+    int64 min_degree = std::numeric_limits<int64>::max();
+    for(size_t i=0; i+1<offsets.size(); ++i){
+        int64 d = offsets[i+1] - offsets[i];
+        if(d > 0)
+            min_degree = std::min(min_degree, d);
+    }
+    if(min_degree == std::numeric_limits<int64>::max())
+        return false;
+    return memory_budget - offsets.back()*EDGE_ALIAS_PAIR_BYTES >= min_degree*EDGE_ALIAS_ENTRY_BYTES;
+}
+
+
+int64 setup_edge_alias(const CSRGraph& graph, EdgeAliasTable& edge_alias, float p, float q, bool has_weights,
+                       int64 memory_budget, thread::ThreadPool* workers, int num_threads){
+    VertexIndex nb_vertices = static_cast<VertexIndex>(graph.offsets.size()) - 1;
+    const std::vector<EdgeOffset>& offsets = graph.offsets;
+
+    // A (target, source) table holds one entry per neighbor of target.
+    // Every edge is traversed equally often in the long run, so filling
+    // the budget with the lowest degree targets first covers the most
+    // walk steps per byte. Pairs left out are sampled by rejection.
+    std::vector<VertexIndex> targets(nb_vertices);
+    for(VertexIndex i=0; i<nb_vertices; ++i)
+        targets[i] = i;
+    auto degree = [&offsets](VertexIndex node){
+        return static_cast<int>(offsets[node+1] - offsets[node]);
+    };
+    std::stable_sort(targets.begin(), targets.end(), [&degree](VertexIndex a, VertexIndex b){
+        return degree(a) < degree(b);
+    });
+
+    // The starts of every edge are needed as soon as one table is built,
+    // so they come out of the budget first.
+    if(!edge_alias_fits(offsets, memory_budget)){
+        edge_alias = EdgeAliasTable();
+        return 0;
+    }
+    int64 budget = memory_budget;
+    if(budget >= 0)
+        budget -= offsets[nb_vertices]*EDGE_ALIAS_PAIR_BYTES;
+
+    // Decide which pairs get a table and where it goes, so that the
+    // tables can then be filled concurrently in preallocated storage.
+    // The first nb_sources[target] neighbors of each target get one.
+    edge_alias.starts.assign(offsets[nb_vertices], -1);
+    std::vector<int32> nb_sources(nb_vertices, 0);
+    int64 nb_entries = 0;
+    int64 nb_precomputed = 0;
+    VertexIndex nb_targets = 0;
+    for(; nb_targets<nb_vertices; ++nb_targets){
+        VertexIndex target = targets[nb_targets];
+        int64 d = degree(target);
+        int64 n = d;
+        if(budget >= 0 && d > 0){
+            int64 pair_cost = d*EDGE_ALIAS_ENTRY_BYTES;
+            n = std::min(d, budget/pair_cost);
+            budget -= n*pair_cost;
+        }
+        if(n == 0 && d > 0)
+            break;
+        nb_sources[target] = n;
+        for(int j=0; j<n; ++j){
+            edge_alias.starts[offsets[target]+j] = nb_entries;
+            nb_entries += d;
+        }
+        nb_precomputed += n;
+    }
+    edge_alias.probas.resize(nb_entries);
+    edge_alias.aliases.resize(nb_entries);
+
+    // Split the targets into one contiguous range of equal cost per
+    // worker thread.
+    int nb_parts = static_cast<int>(std::max<VertexIndex>(1, std::min<VertexIndex>(num_threads, nb_targets)));
+    std::vector<VertexIndex> part_bounds(nb_parts+1, nb_targets);
+    part_bounds[0] = 0;
+    int64 cumulated = 0;
+    int part = 1;
+    for(VertexIndex i=0; i<nb_targets && part<nb_parts; ++i){
+        cumulated += int64(nb_sources[targets[i]])*degree(targets[i]);
+        if(cumulated*nb_parts >= nb_entries*part)
+            part_bounds[part++] = i+1;
+    }
+
+    auto fill_tables = [&](int64 start_part, int64 end_part){
+        for(VertexIndex i=part_bounds[start_part]; i<part_bounds[end_part]; ++i){
+            VertexIndex target = targets[i];
+            const VertexIndex* row = &graph.neighbors[offsets[target]];
+            int d = degree(target);
+            for(int j=0; j<nb_sources[target]; ++j){
+                VertexIndex source = row[j];
+                // Both rows are sorted, so common neighbors are found
+                // by merging them, or by binary searches in the source
+                // row when it is much longer.
+                const VertexIndex* source_it = &graph.neighbors[offsets[source]];
+                const VertexIndex* source_end = source_it + degree(source);
+                bool search = degree(source) > 8*d;
+                int64 start = edge_alias.starts[offsets[target]+j];
+                float* probas = &edge_alias.probas[start];
+                float sum_weights=0;
+                for(int k=0; k<d; ++k){
+                    float weight = 1.;
+                    if(has_weights)
+                        weight = graph.weights[offsets[target]+k];
+                    if(search)
+                        source_it = std::lower_bound(source_it, source_end, row[k]);
+                    else
+                        while(source_it != source_end && *source_it < row[k])
+                            ++source_it;
+                    if(row[k] == source)
+                        weight *= 1./p;
+                    else if(source_it == source_end || *source_it != row[k])
+                        weight *= 1./q;
+                    sum_weights += weight;
+                    probas[k] = weight;
+                }
+                setup_alias_vectors(probas, &edge_alias.aliases[start], d, sum_weights);
+            }
+        }
+    };
+    Shard(nb_parts, workers, nb_parts, std::max<int64>(nb_entries/nb_parts, 1)*100, fill_tables);
+    return nb_precomputed;
 }
 
 
@@ -109,6 +554,11 @@ bool BaseGraphKernel::HasWeights(){
 }
 
 
+bool BaseGraphKernel::IsDirected(){
+    return directed_;
+}
+
+
 void BaseGraphKernel::SetHasWeights(bool b){
     has_weights_ = b;
 }
@@ -16,6 +16,8 @@ limitations under the License.
 #define GRAPH_KERNEL_BASE_H
 
 #include <sstream>
+#include <atomic>
+#include <memory>
 #include <unordered_set>
 #include <unordered_map>
 #include <iterator>
@@ -29,130 +31,211 @@ limitations under the License.
 #include "tensorflow/core/framework/op.h"
 #include "tensorflow/core/framework/op_kernel.h"
 #include "tensorflow/core/lib/random/philox_random.h"
+#include "tensorflow/core/lib/random/random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/lib/strings/strcat.h"
+#include "tensorflow/core/platform/env.h"
+#include "tensorflow/core/platform/mutex.h"
 #include "tensorflow/core/platform/thread_annotations.h"
 #include "tensorflow/core/util/guarded_philox_random.h"
 #include "tensorflow/core/util/work_sharder.h"
 
-#include <boost/graph/adjacency_list.hpp>
-
+#include "graph_builder.h"
 #include "sampling.h"
+#include "graph_snapshot.h"
+#include "walk_queue.h"
 
 
 using namespace tensorflow;
 using namespace std;
 
+// Walks are precomputed by a background thread as whole outputs of Compute
+// (num_batches batches), handed over through a lock-free queue holding about PRECOMPUTE walks. The
+// producer computes rounds of about REFILL_SIZE walks at a time.
 const int PRECOMPUTE = 30000;
-const int LOW_WATER_MARK = 100;
+const int REFILL_SIZE = 2048;
+// Walk k draws its random numbers from the Philox stream whose counter holds
+// k in its high 64 bits, with a key derived from the op seeds, so that it
+// does not depend on which thread generates it. The low 64 bits are split
+// in four: the walk itself uses far fewer than 2^62 samples, the rest holds
+// the streams of the draws made on the walk afterwards: subsampling, then
+// the windows and negatives of skip-gram examples.
+const uint64 SUBSAMPLE_STREAM_OFFSET = uint64(1) << 62;
+const uint64 WINDOW_STREAM_OFFSET = uint64(2) << 62;
+const uint64 NEGATIVE_STREAM_OFFSET = uint64(3) << 62;
 
 
 namespace gseq{
 
-struct VertexProperty
-{
-    std::string id;
-};
-
-
-struct EdgeProperty{
-  float weight;
+// Output of the producer for one call to Compute: walks_per_call_ walks,
+// the first one being the first_walk-th walk of the op.
+struct WalkBatch {
+    Tensor walks;
+    int64 first_walk = 0;
 };
 
-template<bool D>
-struct directed_type{
-  typedef boost::undirectedS type;
-};
 
-template<>
-struct directed_type<true>{
-  typedef boost::directedS type;
-};
+// Builds the first order tables of graph. With compress, the rows are
+// stored in node_alias.compressed rather than node_alias.idx.
+void setup_node_alias(const CSRGraph& graph, AliasTable& node_alias, std::vector<VertexIndex>& valid_nodes,
+                      bool has_weights, bool compress);
 
 
-template<bool D>
-struct graph_types{
-  typedef boost::adjacency_list<boost::vecS, boost::vecS, typename directed_type<D>::type, VertexProperty, EdgeProperty> Graph;
-};
+// Memory cost of the second order alias tables, used to fit them in a
+// memory budget: bytes per table entry and bytes per edge for the start
+// of its (target, source) table, paid for every edge once any is built.
+const int EDGE_ALIAS_ENTRY_BYTES = sizeof(float) + sizeof(int32);
+const int EDGE_ALIAS_PAIR_BYTES = sizeof(int64);
 
+// Whether memory_budget leaves room for at least one node2vec table of the
+// graph with these offsets once the starts of every edge are paid for. A
+// negative budget has no limit.
+bool edge_alias_fits(const std::vector<EdgeOffset>& offsets, int64 memory_budget);
 
-template<typename G> int setup_node_alias(G graph, std::vector<Alias>& node_alias, std::vector<int32>& valid_nodes, bool has_weights) {
-    int32 nb_vertices = static_cast<int32>(boost::num_vertices(graph));
-    node_alias.resize(nb_vertices);
-    int alias_idx = 0;
-    for(int i=0; i<nb_vertices; ++i){
-        typename G::adjacency_iterator vit, vend;
-        std::tie(vit, vend) = boost::adjacent_vertices(i, graph);
-        int nb_neighbors = std::distance(vit, vend);
-        if(nb_neighbors > 0){
-            valid_nodes.push_back(i);
-            // cout << "pushed back " << i << " to valid nodes" << endl;
-            float sum_weights=0;
-            for(auto it = vit; it != vend; ++it){
-                if(has_weights){
-                    auto e = boost::edge(i,*it, graph).first;
-                    float weight = graph[e].weight;
-                    sum_weights += weight;
-                    node_alias[i].probas.push_back(weight);
-                }
-                node_alias[i].idx.push_back(*it);
-                alias_idx++;
-            }
-            if(has_weights){
-                setup_alias_vectors(node_alias[i], sum_weights);
-            }
-        }
-    }
-}
+// Builds the node2vec tables of graph into edge_alias, for every pair or,
+// with a non negative memory_budget, for the pairs of the lowest degree
+// targets that fit in it along with the starts. When none fits, edge_alias
+// is left empty. The tables are filled on workers. Returns the number of
+// pairs that have a table.
+int64 setup_edge_alias(const CSRGraph& graph, EdgeAliasTable& edge_alias, float p, float q, bool has_weights,
+                       int64 memory_budget, thread::ThreadPool* workers, int num_threads);
 
 
 class BaseGraphKernel : public OpKernel {
 public:
     explicit BaseGraphKernel(OpKernelConstruction* ctx);
+    ~BaseGraphKernel() override;
 
     void Compute(OpKernelContext* ctx) override;
 
     bool HasWeights();
+    bool IsDirected();
+    // Whether node ids are int64 numbers rather than strings.
+    bool IntegerIds();
+    bool CompressAdjacency();
     void SetHasWeights(bool b);
 
-    std::vector<Alias>* getNodeAlias();
-    std::vector<int32>* getValidNodes();
+    AliasTable* getNodeAlias();
+    std::vector<VertexIndex>* getValidNodes();
     const std::string& getWeightAttrName();
+    const std::string& getReorder();
     Tensor& getNodeId();
-
-    void InitNodeId(int nb);
-
-    void NextWalk(OpKernelContext* ctx, Tensor& walk, int i) EXCLUSIVE_LOCKS_REQUIRED(mu_);
-
-    void PrecomputeWalks(int write_idx, int start_idx, int end_idx);
-    virtual Status MakeGraphTypeAndInit(Env* env, const string& filename) = 0;
+    int getNumThreads();
+    thread::ThreadPool* getWorkers();
+
+    void InitNodeId(VertexIndex nb);
+
+    // Blocks until a batch of walks is ready.
+    void NextBatch(WalkBatch* batch);
+    // Sets the nb_seqs_per_node, nb_seqs and nb_valid_nodes outputs from
+    // first_output on, counting the walks of one call.
+    void SetCounterOutputs(OpKernelContext* ctx, int first_output);
+
+    // Starts the thread filling the queue of walks, once the graph is set
+    // up. Kernels stop it in their destructor, as it calls PrecomputeWalkGroup.
+    void StartProducer(Env* env);
+    void StopProducer();
+    void ProduceWalks();
+    // Blocks until batch is queued. Returns false if the producer stops.
+    bool PushBatch(WalkBatch& batch);
+    // Fills the walks [start_idx, end_idx) of batches, walk i being the
+    // (first_walk + i)-th walk of the op.
+    void PrecomputeWalks(std::vector<WalkBatch>* batches, int64 first_walk, int64 start_idx, int64 end_idx);
+    // Random stream of walk k, skipped by offset samples.
+    random::PhiloxRandom WalkGenerator(int64 walk, uint64 offset = 0);
+    // Drops the nodes of a walk with probability 1 - keep_proba_[node] and
+    // moves the others to the front, padding the walk with -1.
+    void SubsampleWalk(VertexIndex* walk, int64 walk_idx);
+    void SetupSubsampling();
+    // Estimated cost of a walk step, used to shard the walk generation.
+    virtual int64 StepCost();
+    // Reads filename and sets up the node id and alias structures.
+    virtual Status BuildGraph(Env* env, const string& filename) = 0;
 
     virtual Status Init(Env* env, const string& filename) = 0;
-    virtual void PrecomputeWalk(int walk_idx, int start_node, random::SimplePhilox& gen) = 0;
+    // Writes seq_size_ nodes to each of walks[0..nb_walks), whose first node
+    // is set, walk w drawing from gens[w]. Kernels advance the walks in
+    // lockstep (see interleaved_walks).
+    virtual void PrecomputeWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks) = 0;
+    // First order walks for PrecomputeWalkGroup, with the sampler and the
+    // row layout chosen at compile time rather than at every step.
+    template<bool Weighted, bool Compressed>
+    void FirstOrderWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks);
+
+    // Loads the preprocessed graph from snapshot_ if it exists, otherwise
+    // builds it from filename and writes snapshot_ when one is given.
+    Status LoadOrBuildGraph(Env* env, const string& filename);
+    // Describes everything the preprocessing depends on; a snapshot is only
+    // loaded by a kernel with the same parameters.
+    virtual string SnapshotParameters();
+    virtual Status WriteSnapshot(SnapshotWriter* writer);
+    virtual Status ReadSnapshot(SnapshotReader* reader);
+    // DataLoss unless the arrays read from the snapshot are consistent, so
+    // that a corrupted file can't make the walks read out of bounds.
+    Status CheckSnapshot();
 protected:
     int32 batchsize_ = 128;
+    int32 num_batches_ = 1;
+    // Walks returned by one call to Compute, the producer builds tensors of
+    // this many walks so that Compute outputs them without copies.
+    int64 walks_per_call_ = 128;
     int32 seq_size_ = 0;
-    int32 graph_size_ = 0;
     bool directed_ = false;
     std::string weight_attr_name_;
+    std::string snapshot_;
+    // Path, size and modification time of the input file, part of the
+    // snapshot parameters so that a snapshot of an older input is rejected.
+    std::string snapshot_source_;
+    // Vertex order applied after reading the graph (see vertex_order).
+    std::string reorder_;
+    DataType id_type_ = DT_STRING;
+    // Stores the neighbors as CompressedRows.
+    bool compress_adjacency_ = false;
 
     Tensor node_id_;
-    std::vector<int32> valid_nodes_;
-
+    std::vector<VertexIndex> valid_nodes_;
+
+    int64 seed_ = 0;
+    int64 seed2_ = 0;
+    // Philox key of the walk streams, mixed from both seeds since the
+    // counter has no room left for seed2_.
+    random::PhiloxRandom::Key walk_key_;
+    float subsample_ = 0;
+    // Probability to keep each node when subsample_ is set.
+    std::vector<float> keep_proba_;
+    std::atomic<int64> total_seq_generated_{0};
+    // Only used by the producer thread.
+    int64 produced_walks_ = 0;
+    std::unique_ptr<WalkQueue<WalkBatch>> walk_queue_;
+    std::unique_ptr<Thread> producer_;
+    // Compute and the producer only lock mu_ to sleep when the queue is
+    // empty or full. The waiting flags tell the other side to wake them.
     tensorflow::mutex mu_;
-    GuardedPhiloxRandom guarded_philox_ GUARDED_BY(mu_);
-    int32 current_epoch_ GUARDED_BY(mu_) = -1;
-    int32 total_seq_generated_ GUARDED_BY(mu_) = 0;
-    int32 current_node_idx_ GUARDED_BY(mu_) = 0;
-    Tensor precomputed_walks;
-    int cur_walk_idx;
-    int write_walk_idx;
+    tensorflow::condition_variable walks_ready_;
+    tensorflow::condition_variable slots_free_;
+    std::atomic<int> waiting_consumers_{0};
+    std::atomic<bool> producer_waiting_{false};
+    std::atomic<bool> stop_producer_{false};
     int num_threads_;
+    thread::ThreadPool* workers_ = nullptr;
     bool has_weights_ = false;
-    std::vector<Alias> node_alias_;
+    AliasTable node_alias_;
 
 };
 
 
+template<bool Weighted, bool Compressed>
+void BaseGraphKernel::FirstOrderWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks){
+    auto step = [this, walks, gens, nb_walks](int k, VertexIndex* nodes){
+        VertexIndex cur_nodes[WALK_GROUP_SIZE];
+        for(int w=0; w<nb_walks; ++w)
+            cur_nodes[w] = walks[w][k-1];
+        sample_first_order<Weighted, Compressed>(node_alias_, cur_nodes, gens, nodes, nb_walks);
+    };
+    interleaved_walks<Compressed>(node_alias_, walks, nb_walks, seq_size_, step);
+}
+
+
 } // Namespace
 
 #endif // GRAPH_KERNEL_BASE_H
\ No newline at end of file
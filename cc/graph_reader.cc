@@ -0,0 +1,324 @@
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+
+#include <tensorflow/core/lib/strings/strcat.h>
+#include <tensorflow/core/util/work_sharder.h>
+#include <boost/filesystem.hpp>
+#include <boost/graph/graphml.hpp>
+#include "file_contents.h"
+#include "graph_reader.h"
+
+namespace gseq{
+
+Int64IndexMap::Int64IndexMap(size_t expected_size){
+    size_t capacity = 16;
+    while(capacity < 2*expected_size)
+        capacity *= 2;
+    keys_.resize(capacity);
+    values_.assign(capacity, -1);
+}
+
+
+size_t Int64IndexMap::Slot(int64 id) const {
+    // Fibonacci hashing spreads consecutive ids over the table.
+    uint64 h = static_cast<uint64>(id)*11400714819323198485ULL;
+    size_t mask = keys_.size() - 1;
+    size_t slot = (h >> 32) & mask;
+    while(values_[slot] >= 0 && keys_[slot] != id)
+        slot = (slot + 1) & mask;
+    return slot;
+}
+
+
+VertexIndex Int64IndexMap::Find(int64 id) const {
+    return values_[Slot(id)];
+}
+
+
+void Int64IndexMap::Insert(int64 id, VertexIndex index){
+    if(2*(size_ + 1) > keys_.size())
+        Grow();
+    size_t slot = Slot(id);
+    keys_[slot] = id;
+    values_[slot] = index;
+    ++size_;
+}
+
+
+void Int64IndexMap::Grow(){
+    std::vector<int64> keys(2*keys_.size());
+    std::vector<VertexIndex> values(2*keys_.size(), -1);
+    keys.swap(keys_);
+    values.swap(values_);
+    for(size_t i=0; i<keys.size(); ++i){
+        if(values[i] >= 0){
+            size_t slot = Slot(keys[i]);
+            keys_[slot] = keys[i];
+            values_[slot] = values[i];
+        }
+    }
+}
+
+
+Status EdgeListReader::ReadEdgeList(const char* data, size_t size,
+                                    thread::ThreadPool* workers, int num_threads){
+    bool has_weights = m_builder->HasWeights();
+    bool integer_ids = m_builder->IntegerIds();
+    int nb_chunks = std::max<size_t>(1, std::min<size_t>(num_threads, size/EDGELIST_MIN_CHUNK_SIZE));
+    std::vector<EdgeListChunk> chunks(nb_chunks);
+    const char* begin = data;
+    for(int c=0; c<nb_chunks; ++c){
+        const char* end = data + size*(c+1)/nb_chunks;
+        const char* eol = static_cast<const char*>(memchr(end, '\n', data + size - end));
+        end = (c == nb_chunks-1 || eol == nullptr) ? data + size : eol + 1;
+        chunks[c].begin = begin;
+        chunks[c].end = std::max(begin, end);
+        begin = chunks[c].end;
+    }
+
+    auto parse = [&chunks, has_weights, integer_ids](int64 start, int64 end){
+        for(int64 c=start; c<end; ++c)
+            ParseChunk(&chunks[c], has_weights, integer_ids);
+    };
+    if(workers != nullptr && nb_chunks > 1)
+        Shard(nb_chunks, workers, nb_chunks, std::numeric_limits<int32>::max(), parse);
+    else
+        parse(0, nb_chunks);
+
+    for(auto& chunk : chunks){
+        if(chunk.bad_line > 0){
+            int64 line_number = std::count(data, chunk.begin, '\n') + chunk.bad_line;
+            return errors::InvalidArgument("Line ", line_number, chunk.error);
+        }
+    }
+
+    if(integer_ids){
+        AddIntegerEdges(&chunks);
+        return Status::OK();
+    }
+
+    std::vector<std::vector<VertexIndex>> remap(nb_chunks);
+    for(int c=0; c<nb_chunks; ++c){
+        remap[c].reserve(chunks[c].vertices.size());
+        for(StringPiece v : chunks[c].vertices)
+            remap[c].push_back(HandleVertex(v));
+    }
+    auto remap_edges = [&chunks, &remap](int64 start, int64 end){
+        for(int64 c=start; c<end; ++c){
+            for(auto& v : chunks[c].sources)
+                v = remap[c][v];
+            for(auto& v : chunks[c].targets)
+                v = remap[c][v];
+        }
+    };
+    if(workers != nullptr && nb_chunks > 1)
+        Shard(nb_chunks, workers, nb_chunks, std::numeric_limits<int32>::max(), remap_edges);
+    else
+        remap_edges(0, nb_chunks);
+
+    for(auto& chunk : chunks){
+        for(size_t e=0; e<chunk.sources.size(); ++e)
+            m_builder->AddEdge(chunk.sources[e], chunk.targets[e], has_weights ? chunk.weights[e] : 1.f);
+        // Release the chunk as soon as it is in the builder.
+        chunk = EdgeListChunk();
+    }
+    return Status::OK();
+}
+
+
+void EdgeListReader::AddIntegerEdges(std::vector<EdgeListChunk>* chunks){
+    bool has_weights = m_builder->HasWeights();
+    int64 min_id = std::numeric_limits<int64>::max();
+    int64 max_id = std::numeric_limits<int64>::min();
+    size_t nb_ids = 0;
+    for(auto& chunk : *chunks){
+        min_id = std::min(min_id, chunk.min_id);
+        max_id = std::max(max_id, chunk.max_id);
+        nb_ids += chunk.edge_ids.size();
+    }
+    // No edges: the bounds are still at their defaults.
+    if(nb_ids == 0)
+        return;
+    // Ids numbered from 0 without large gaps, as most edge lists have, are
+    // looked up in a flat array.
+    bool dense = min_id <= max_id && min_id >= 0 && max_id < static_cast<int64>(2*nb_ids + 1024);
+    std::vector<VertexIndex> flat_index(dense ? max_id + 1 : 0, -1);
+    Int64IndexMap index(dense ? 0 : nb_ids/2);
+    auto vertex = [&](int64 id){
+        VertexIndex v = dense ? flat_index[id] : index.Find(id);
+        if(v < 0){
+            v = m_builder->AddIntVertex(id);
+            if(dense)
+                flat_index[id] = v;
+            else
+                index.Insert(id, v);
+        }
+        return v;
+    };
+    for(auto& chunk : *chunks){
+        for(size_t e=0; 2*e<chunk.edge_ids.size(); ++e){
+            VertexIndex source = vertex(chunk.edge_ids[2*e]);
+            VertexIndex target = vertex(chunk.edge_ids[2*e+1]);
+            m_builder->AddEdge(source, target, has_weights ? chunk.weights[e] : 1.f);
+        }
+        chunk = EdgeListChunk();
+    }
+}
+
+
+void EdgeListReader::ParseChunk(EdgeListChunk* chunk, bool has_weights, bool integer_ids){
+    const char* line = chunk->begin;
+    int64 line_number = 0;
+    // One token more than expected, to tell lines with extra columns.
+    int nb_columns = 2 + has_weights;
+    StringPiece tokens[4];
+    while(line < chunk->end){
+        const char* eol = static_cast<const char*>(memchr(line, '\n', chunk->end - line));
+        if(eol == nullptr)
+            eol = chunk->end;
+        ++line_number;
+        int nb_tokens = Tokenize(line, eol, tokens, nb_columns + 1);
+        if(nb_tokens > 0 && tokens[0][0] != '#'){
+            if(nb_tokens != nb_columns){
+                chunk->bad_line = line_number;
+                chunk->error = strings::StrCat(" '", StringPiece(line, eol - line),
+                                               "' has unexpected format, expected ",
+                                               has_weights ? "'node1 node2 weight'" : "'node1 node2'");
+                return;
+            }
+            float weight = 1.;
+            if(has_weights){
+                if(!ParseFloat(tokens[2], &weight)){
+                    chunk->bad_line = line_number;
+                    chunk->error = strings::StrCat(": invalid weight '", tokens[2], "'");
+                    return;
+                }
+                chunk->weights.push_back(weight);
+            }
+            if(integer_ids){
+                for(int t=0; t<2; ++t){
+                    int64 id;
+                    if(!ParseInt64(tokens[t], &id)){
+                        chunk->bad_line = line_number;
+                        chunk->error = strings::StrCat(": node id '", tokens[t], "' is not an integer");
+                        return;
+                    }
+                    chunk->edge_ids.push_back(id);
+                    chunk->min_id = std::min(chunk->min_id, id);
+                    chunk->max_id = std::max(chunk->max_id, id);
+                }
+            }
+            else{
+                chunk->sources.push_back(LocalVertex(chunk, tokens[0]));
+                chunk->targets.push_back(LocalVertex(chunk, tokens[1]));
+            }
+        }
+        line = eol + 1;
+    }
+}
+
+
+int EdgeListReader::Tokenize(const char* begin, const char* end, StringPiece* tokens, int max_tokens){
+    int nb_tokens = 0;
+    const char* it = begin;
+    while(nb_tokens < max_tokens){
+        while(it != end && IsSpace(*it))
+            ++it;
+        if(it == end)
+            break;
+        const char* start = it;
+        while(it != end && !IsSpace(*it))
+            ++it;
+        tokens[nb_tokens++] = StringPiece(start, it - start);
+    }
+    return nb_tokens;
+}
+
+
+bool EdgeListReader::ParseFloat(StringPiece token, float* value){
+    char buffer[64];
+    if(token.size() >= sizeof(buffer))
+        return false;
+    memcpy(buffer, token.data(), token.size());
+    buffer[token.size()] = '\0';
+    char* parsed_end;
+    *value = strtof(buffer, &parsed_end);
+    return token.size() > 0 && parsed_end == buffer + token.size();
+}
+
+
+bool EdgeListReader::ParseInt64(StringPiece token, int64* value){
+    char buffer[32];
+    if(token.size() >= sizeof(buffer))
+        return false;
+    memcpy(buffer, token.data(), token.size());
+    buffer[token.size()] = '\0';
+    char* parsed_end;
+    errno = 0;
+    *value = strtoll(buffer, &parsed_end, 10);
+    return token.size() > 0 && errno == 0 && parsed_end == buffer + token.size();
+}
+
+
+VertexIndex EdgeListReader::HandleVertex(StringPiece v){
+    return m_builder->InternVertex(v);
+}
+
+
+VertexIndex EdgeListReader::LocalVertex(EdgeListChunk* chunk, StringPiece v){
+    uint64 hash = chunk->index.Hash(v);
+    VertexIndex vertex = chunk->index.Find(chunk->vertices, v, hash);
+    if(vertex < 0){
+        vertex = static_cast<VertexIndex>(chunk->vertices.size());
+        chunk->vertices.push_back(v);
+        chunk->index.Insert(chunk->vertices, vertex, hash);
+    }
+    return vertex;
+}
+
+
+Status read_graphml(const char* data, size_t size, GraphBuilder* builder, const string& weight_attr){
+    try{
+        parse_graphml(data, size, builder, weight_attr, 0);
+    }catch(const boost::graph_exception& e){
+        return errors::InvalidArgument(e.what());
+    }
+    return Status::OK();
+}
+
+
+Status read_edgelist(const char* data, size_t size, GraphBuilder* builder,
+                     thread::ThreadPool* workers, int num_threads){
+    EdgeListReader reader(builder);
+    return reader.ReadEdgeList(data, size, workers, num_threads);
+}
+
+
+Status read_edgelist(std::istream& data_stream, GraphBuilder* builder){
+    std::string data((std::istreambuf_iterator<char>(data_stream)), std::istreambuf_iterator<char>());
+    return read_edgelist(data.data(), data.size(), builder);
+}
+
+
+Status read_graph(Env* env, const std::string& filename, GraphBuilder* builder, const string& weight_attr,
+                  thread::ThreadPool* workers, int num_threads){
+    FileContents contents;
+    TF_RETURN_IF_ERROR(contents.Open(env, filename));
+    const char* data = contents.data();
+    boost::filesystem::path path = filename;
+    std::string ext = path.extension().string();
+    if(ext == ".graphml"){
+        Status status = read_graphml(data, contents.size(), builder, weight_attr);
+        if(!status.ok())
+            return errors::InvalidArgument("Could not parse ", filename, ": ", status.error_message());
+        return Status::OK();
+    }
+    return read_edgelist(data, contents.size(), builder, workers, num_threads);
+}
+
+} // Namespace
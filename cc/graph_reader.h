@@ -1,139 +1,139 @@
 #ifndef GRAPH_READER_H
 #define GRAPH_READER_H
 
-#include <cassert>
-#include <map>
+#include <istream>
+#include <limits>
+#include <string>
+#include <vector>
 
+#include <tensorflow/core/lib/core/errors.h>
 #include <tensorflow/core/lib/core/status.h>
-#include <boost/filesystem.hpp>
-#include <boost/graph/graphml.hpp>
-#include "graph_kernel_base.h"
+#include <tensorflow/core/lib/core/stringpiece.h>
+#include <tensorflow/core/lib/core/threadpool.h>
+#include <tensorflow/core/platform/env.h>
+#include "graph_builder.h"
+#include "string_interner.h"
 
 using namespace tensorflow;
 
 namespace gseq{
 
-template<typename Graph>
-void read_graphml(std::istream& data_stream, Graph& graph, boost::dynamic_properties& dp){
-    boost::read_graphml(data_stream, graph, dp);
-}
+// Open addressing hash map from int64 vertex ids to vertex indices, probed
+// linearly. Ids are stored inline, so a lookup touches a single array in
+// most cases.
+class Int64IndexMap {
+public:
+    explicit Int64IndexMap(size_t expected_size = 0);
+
+    // Index of id, or -1 if it is not in the map.
+    VertexIndex Find(int64 id) const;
+    // Maps id to index, id must not be in the map.
+    void Insert(int64 id, VertexIndex index);
+
+private:
+    size_t Slot(int64 id) const;
+    void Grow();
+
+    std::vector<int64> keys_;
+    // -1 for free slots.
+    std::vector<VertexIndex> values_;
+    size_t size_ = 0;
+};
+
 
+// Minimum number of bytes of edge list parsed by one thread.
+const size_t EDGELIST_MIN_CHUNK_SIZE = 1 << 20;
+
+
+// Edges of a range of lines of an edge list, with vertices numbered locally
+// in order of first appearance in the range.
+struct EdgeListChunk {
+    const char* begin;
+    const char* end;
+    std::vector<StringPiece> vertices;
+    StringInterner<std::vector<StringPiece>> index;
+    std::vector<VertexIndex> sources;
+    std::vector<VertexIndex> targets;
+    // With integer ids, the (source, target) ids of every edge instead of
+    // local vertices, and their bounds.
+    std::vector<int64> edge_ids;
+    int64 min_id = std::numeric_limits<int64>::max();
+    int64 max_id = std::numeric_limits<int64>::min();
+    std::vector<float> weights;
+    // Line of the first malformed line relative to the chunk, or 0.
+    int64 bad_line = 0;
+    string error;
+};
 
+
+// Parses an edge list held in memory, one "node1 node2 [weight]" line per
+// edge, '#' starting a comment line. Tokens are read in place and vertex ids
+// are interned as StringPieces into the buffer within a chunk, so the buffer
+// must outlive the reader, then copied once into the intern table of the
+// builder. A weight is expected on every line when the builder has weights.
+//
+// The buffer is split at line boundaries into one chunk per thread. Chunks
+// are parsed concurrently into local edge buffers, then their vertices are
+// merged chunk after chunk, which numbers them in order of first appearance
+// in the file as a sequential read would, and the edges are remapped.
+//
+// When the builder has integer ids, tokens are parsed as int64 ids instead
+// of being interned. They are mapped to vertices through a flat array when
+// they are dense enough, and through an Int64IndexMap otherwise.
 class EdgeListReader {
 public:
-    EdgeListReader(boost::mutate_graph& g) 
-        : m_g(g) { }
-
-    void ReadEdgeList(std::istream& data_stream, bool has_weights, const std::string& weight_attr_name){
-        std::string line;
-        std::getline(data_stream, line);
-        while(line[0] == '#' && std::getline(data_stream, line)){
-        }
-        assert(data_stream && "unexpected EOF while reading edge list");
-        bool saw_space=false;
-        int nb_spaces = 0;
-        for(char& x : line){
-            if(x == ' ')
-                saw_space = true;
-            else{
-                nb_spaces += saw_space;
-                saw_space = false;
-            }
-        }
-        assert(((has_weights && nb_spaces == 2) || !has_weights) && "Has weights: True. Expected line format 'node1 node2 weight'");
-        assert(((!has_weights && nb_spaces == 1) || has_weights) && "Has weights: False. Expected line format 'node1 node2'");
-
-        std::istringstream line_stream;
-        do{
-            if(line[0] != '#'){
-                line_stream.str(line);
-                try{
-                    HandleLine(line_stream, has_weights, weight_attr_name);
-                } catch(std::istream::failure &E){
-                    cerr << "Line " << line << " has unexpected format" << endl;
-                    throw E;
-                }
-                line_stream.clear();
-            } 
-        } while(std::getline(data_stream, line));
-    }
+    EdgeListReader(GraphBuilder* builder)
+        : m_builder(builder) { }
 
-    void HandleLine(std::istringstream& line, bool has_weights, const std::string& weight_attr_name){
-        std::string node1, node2, weight;
-        line >> node1 >> node2;
-        if(has_weights)
-            line >> weight;
-        HandleEdge(node1, node2, has_weights, weight, weight_attr_name);
-    }
+    Status ReadEdgeList(const char* data, size_t size,
+                        thread::ThreadPool* workers = nullptr, int num_threads = 1);
 
-    void HandleVertex(const std::string& v){
-        bool is_new = m_vertex.find(v) == m_vertex.end();
-        if (is_new){
-            auto node_idx = m_g.do_add_vertex();
-            m_vertex[v] = node_idx;
-            m_g.set_vertex_property("id", node_idx, v, "string");
-        }
-    }
+    static void ParseChunk(EdgeListChunk* chunk, bool has_weights, bool integer_ids = false);
 
+    // Splits [begin, end) on spaces, tabs and carriage returns into at most
+    // max_tokens tokens. Returns the number of tokens found.
+    static int Tokenize(const char* begin, const char* end, StringPiece* tokens, int max_tokens);
 
-    void HandleEdge(const std::string& u, const std::string& v, bool has_weights, const std::string& weight, const std::string& weight_attr_name){
-        HandleVertex(u); HandleVertex(v);
-        boost::any source, target;
-        source = m_vertex[u];
-        target = m_vertex[v];
-
-        boost::any edge;
-        bool added;
-        boost::tie(edge, added) = m_g.do_add_edge(source, target);
-        if(!added)
-            BOOST_THROW_EXCEPTION(boost::bad_parallel_edge(u, v));
-        if(has_weights)
-            m_g.set_edge_property(weight_attr_name, edge, weight, "float");
-        m_edge_idx++;
-    }
+    static bool ParseFloat(StringPiece token, float* value);
+    static bool ParseInt64(StringPiece token, int64* value);
+
+    VertexIndex HandleVertex(StringPiece v);
 
 private:
-    boost::mutate_graph& m_g;
-    std::map<std::string, boost::any> m_vertex;
-    size_t m_edge_idx = 0;
-};
+    static bool IsSpace(char c){
+        return c == ' ' || c == '\t' || c == '\r';
+    }
 
+    static VertexIndex LocalVertex(EdgeListChunk* chunk, StringPiece v);
+    // Adds the edges of chunks with integer ids to the builder.
+    void AddIntegerEdges(std::vector<EdgeListChunk>* chunks);
 
-template<typename Graph>
-void read_edgelist(std::istream& data_stream, Graph& graph, boost::dynamic_properties& dp, bool has_weights, const std::string& weight_attr_name){
-    boost::mutate_graph_impl<Graph> mg(graph, dp);
-    EdgeListReader reader(mg);
-    reader.ReadEdgeList(data_stream, has_weights, weight_attr_name);
-}
+    GraphBuilder* m_builder;
+};
 
 
-template<typename Graph>
-void read_edgelist(std::istream& data_stream, Graph& graph, boost::dynamic_properties& dp){
-    const string s;
-    read_edgelist(data_stream, graph, dp, false, s);
-}
+// Streaming graphml reader (graphml.cc): the buffer is tokenized in a single
+// pass, without building a document tree, straight into builder. Vertices are
+// named by their "id" attribute, which must be an integer when the builder
+// has integer ids, and the weight_attr data of edges gives their weight.
+// Other data is ignored. Errors are thrown as boost::graph_exception.
+void parse_graphml(const char* data, size_t size, GraphBuilder* builder, const string& weight_attr,
+                   size_t desired_idx);
 
+Status read_graphml(const char* data, size_t size, GraphBuilder* builder, const string& weight_attr);
 
+Status read_edgelist(const char* data, size_t size, GraphBuilder* builder,
+                     thread::ThreadPool* workers = nullptr, int num_threads = 1);
 
-template <typename Graph>
-Status read_graph(Env* env, const std::string& filename, Graph& graph, boost::dynamic_properties& dp, bool has_weight, const std::string& weight_attr_name){
-    assert(boost::filesystem::exists(filename) && "The input file doesn't exist");
-    string data;
-    TF_RETURN_IF_ERROR(ReadFileToString(env, filename, &data));
-    std::istringstream data_stream;
-    data_stream.str(data);
-    boost::filesystem::path path = filename;
-    std::string ext = path.extension().string();
-    if(ext == ".graphml"){
-        gseq::read_graphml(data_stream, graph, dp);
-    }
-    else{
-        read_edgelist(data_stream, graph, dp, has_weight, weight_attr_name);
-    }
-    return Status::OK();
-}
+Status read_edgelist(std::istream& data_stream, GraphBuilder* builder);
+
+// Reads filename into builder, as graphml if its extension is ".graphml" and
+// as an edge list otherwise. The file is mapped rather than read into memory
+// when its file system allows it (see FileContents).
+Status read_graph(Env* env, const std::string& filename, GraphBuilder* builder, const string& weight_attr,
+                  thread::ThreadPool* workers = nullptr, int num_threads = 1);
 
 
 } // Namespace
 
-#endif // GRAPH_READER_H
\ No newline at end of file
+#endif // GRAPH_READER_H
@@ -0,0 +1,123 @@
+#include <algorithm>
+#include <cstring>
+#include "graph_snapshot.h"
+
+namespace gseq{
+
+namespace {
+
+const char PADDING[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+
+uint64 padded(uint64 size){
+    return (size + 7) & ~uint64(7);
+}
+
+} // Namespace
+
+
+Status SnapshotWriter::Open(Env* env, const string& filename){
+    env_ = env;
+    filename_ = filename;
+    TF_RETURN_IF_ERROR(env->NewWritableFile(filename + ".tmp", &file_));
+    TF_RETURN_IF_ERROR(file_->Append(StringPiece(SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC))));
+    return file_->Append(StringPiece(reinterpret_cast<const char*>(&SNAPSHOT_VERSION), sizeof(SNAPSHOT_VERSION)));
+}
+
+
+Status SnapshotWriter::Close(){
+    TF_RETURN_IF_ERROR(file_->Close());
+    file_.reset();
+    return env_->RenameFile(filename_ + ".tmp", filename_);
+}
+
+
+Status SnapshotWriter::WriteBytes(const void* data, uint64 size){
+    TF_RETURN_IF_ERROR(file_->Append(StringPiece(reinterpret_cast<const char*>(&size), sizeof(size))));
+    if(size > 0)
+        TF_RETURN_IF_ERROR(file_->Append(StringPiece(reinterpret_cast<const char*>(data), size)));
+    return file_->Append(StringPiece(PADDING, padded(size) - size));
+}
+
+
+Status SnapshotWriter::WriteStrings(const Tensor& strings){
+    auto flat = strings.flat<string>();
+    std::vector<uint64> offsets(flat.size()+1, 0);
+    for(int64 i=0; i<flat.size(); ++i)
+        offsets[i+1] = offsets[i] + flat(i).size();
+    string blob;
+    blob.reserve(offsets.back());
+    for(int64 i=0; i<flat.size(); ++i)
+        blob.append(flat(i));
+    TF_RETURN_IF_ERROR(WriteArray(offsets));
+    return WriteBytes(blob.data(), blob.size());
+}
+
+
+Status SnapshotWriter::WriteInt64s(const Tensor& values){
+    return WriteBytes(values.flat<int64>().data(), values.NumElements()*sizeof(int64));
+}
+
+
+Status SnapshotReader::Open(Env* env, const string& filename){
+    filename_ = filename;
+    TF_RETURN_IF_ERROR(contents_.Open(env, filename));
+    uint64 version;
+    if(contents_.size() < sizeof(SNAPSHOT_MAGIC) + sizeof(version)
+       || memcmp(contents_.data(), SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC)) != 0)
+        return errors::DataLoss(filename, " is not a graph snapshot");
+    position_ = sizeof(SNAPSHOT_MAGIC);
+    memcpy(&version, contents_.data() + position_, sizeof(version));
+    position_ += sizeof(version);
+    if(version != SNAPSHOT_VERSION)
+        return errors::InvalidArgument("Snapshot ", filename, " has version ", version,
+                                       ", expected ", SNAPSHOT_VERSION);
+    return Status::OK();
+}
+
+
+Status SnapshotReader::ReadBytes(const char** data, uint64* size){
+    const char* base = contents_.data();
+    uint64 length = contents_.size();
+    if(position_ + sizeof(uint64) > length)
+        return errors::DataLoss("Truncated snapshot ", filename_);
+    memcpy(size, base + position_, sizeof(uint64));
+    position_ += sizeof(uint64);
+    if(*size > length - position_)
+        return errors::DataLoss("Truncated snapshot ", filename_);
+    *data = base + position_;
+    position_ += padded(*size);
+    return Status::OK();
+}
+
+
+Status SnapshotReader::ReadStrings(Tensor* strings){
+    std::vector<uint64> offsets;
+    TF_RETURN_IF_ERROR(ReadArray(&offsets));
+    const char* blob;
+    uint64 size;
+    TF_RETURN_IF_ERROR(ReadBytes(&blob, &size));
+    if(offsets.empty() || offsets.back() != size)
+        return errors::DataLoss("Corrupted vocabulary in snapshot ", filename_);
+    // Non-decreasing offsets ending at size stay within the blob.
+    for(size_t i=0; i+1<offsets.size(); ++i){
+        if(offsets[i+1] < offsets[i])
+            return errors::DataLoss("Corrupted vocabulary in snapshot ", filename_);
+    }
+    int64 n = offsets.size() - 1;
+    *strings = Tensor(DT_STRING, TensorShape({n}));
+    auto flat = strings->flat<string>();
+    for(int64 i=0; i<n; ++i)
+        flat(i).assign(blob + offsets[i], offsets[i+1] - offsets[i]);
+    return Status::OK();
+}
+
+
+Status SnapshotReader::ReadInt64s(Tensor* values){
+    std::vector<int64> array;
+    TF_RETURN_IF_ERROR(ReadArray(&array));
+    *values = Tensor(DT_INT64, TensorShape({static_cast<int64>(array.size())}));
+    std::copy(array.begin(), array.end(), values->flat<int64>().data());
+    return Status::OK();
+}
+
+} // Namespace
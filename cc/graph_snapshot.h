@@ -0,0 +1,93 @@
+#ifndef GRAPH_SNAPSHOT_H
+#define GRAPH_SNAPSHOT_H
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/framework/tensor.h"
+#include "tensorflow/core/lib/core/errors.h"
+#include "tensorflow/core/lib/core/status.h"
+#include "tensorflow/core/platform/env.h"
+#include "file_contents.h"
+
+using namespace tensorflow;
+
+namespace gseq{
+
+// Binary snapshot of a preprocessed graph: vocabulary, valid nodes and alias
+// tables, so that kernels can skip parsing and preprocessing on restart.
+//
+// The file starts with SNAPSHOT_MAGIC and SNAPSHOT_VERSION, followed by
+// records written and read back in the same order. A record is a uint64
+// byte count followed by the raw bytes, padded to 8 bytes so that every
+// array is aligned in the mapped file.
+const char SNAPSHOT_MAGIC[8] = {'G', 'S', 'E', 'Q', 'S', 'N', 'A', 'P'};
+const uint64 SNAPSHOT_VERSION = 3;
+
+
+class SnapshotWriter {
+public:
+    // Records are written to filename.tmp, renamed to filename by Close.
+    Status Open(Env* env, const string& filename);
+    Status Close();
+
+    Status WriteBytes(const void* data, uint64 size);
+    Status WriteStrings(const Tensor& strings);
+    Status WriteInt64s(const Tensor& values);
+
+    template<typename T> Status WriteScalar(T value){
+        return WriteBytes(&value, sizeof(T));
+    }
+
+    template<typename T> Status WriteArray(const std::vector<T>& array){
+        return WriteBytes(array.data(), array.size()*sizeof(T));
+    }
+
+private:
+    Env* env_ = nullptr;
+    string filename_;
+    std::unique_ptr<WritableFile> file_;
+};
+
+
+class SnapshotReader {
+public:
+    // Maps the file in memory, or reads it where it can't be mapped, and
+    // checks its header.
+    Status Open(Env* env, const string& filename);
+
+    Status ReadBytes(const char** data, uint64* size);
+    Status ReadStrings(Tensor* strings);
+    Status ReadInt64s(Tensor* values);
+
+    template<typename T> Status ReadScalar(T* value){
+        const char* data;
+        uint64 size;
+        TF_RETURN_IF_ERROR(ReadBytes(&data, &size));
+        if(size != sizeof(T))
+            return errors::DataLoss("Unexpected record size in snapshot ", filename_);
+        memcpy(value, data, sizeof(T));
+        return Status::OK();
+    }
+
+    template<typename T> Status ReadArray(std::vector<T>* array){
+        const char* data;
+        uint64 size;
+        TF_RETURN_IF_ERROR(ReadBytes(&data, &size));
+        if(size % sizeof(T) != 0)
+            return errors::DataLoss("Unexpected record size in snapshot ", filename_);
+        const T* begin = reinterpret_cast<const T*>(data);
+        array->assign(begin, begin + size/sizeof(T));
+        return Status::OK();
+    }
+
+private:
+    string filename_;
+    FileContents contents_;
+    uint64 position_ = 0;
+};
+
+} // Namespace
+
+#endif // GRAPH_SNAPSHOT_H
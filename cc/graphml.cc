@@ -10,14 +10,19 @@
 //           Andrew Lumsdaine
 //           Tiago de Paula Peixoto
 
-#define BOOST_GRAPH_SOURCE
-#include <boost/foreach.hpp>
-#include <boost/optional.hpp>
+// The reader below is a streaming rewrite of Boost's property_tree based
+// graphml reader: the document is tokenized in a single pass and vertices,
+// edges and weights go straight into a GraphBuilder as their elements are
+// read, so no DOM of the document is ever built and no boost::mutate_graph
+// boxes them on the way.
+
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
 #include <boost/throw_exception.hpp>
 #include <boost/graph/graphml.hpp>
-#include <boost/graph/dll_import_export.hpp>
-#include <boost/property_tree/ptree.hpp>
-#include <boost/property_tree/xml_parser.hpp>
+#include "graph_reader.h"
 
 using namespace boost;
 
@@ -26,56 +31,249 @@ namespace {
 class graphml_reader
 {
 public:
-    graphml_reader(mutate_graph& g) 
-        : m_g(g) { }
+    graphml_reader(gseq::GraphBuilder* builder, const std::string& weight_attr)
+        : m_builder(builder), m_weight_attr(weight_attr) { }
 
-    static boost::property_tree::ptree::path_type path(const std::string& str) {
-      return boost::property_tree::ptree::path_type(str, '/');
+    void run(const char* data, size_t size, size_t desired_idx)
+    {
+      m_it = data;
+      m_end = data + size;
+      m_desired_idx = desired_idx;
+      while (m_it != m_end) {
+        if (*m_it != '<') {
+          const char* text_end = find_char('<');
+          if (in_data())
+            decode(m_it, text_end, m_text);
+          m_it = text_end;
+          continue;
+        }
+        if (starts_with("<?")) {
+          skip_past("?>");
+        } else if (starts_with("<!--")) {
+          skip_past("-->");
+        } else if (starts_with("<![CDATA[")) {
+          const char* begin = m_it + 9;
+          skip_past("]]>");
+          if (in_data())
+            m_text.append(begin, m_it - 3);
+        } else if (starts_with("<!")) {
+          skip_past(">");
+        } else if (starts_with("</")) {
+          m_it += 2;
+          std::string name = read_name();
+          skip_spaces();
+          expect('>');
+          end_element(name);
+        } else {
+          ++m_it;
+          start_element();
+        }
+      }
+      if (!m_elements.empty())
+        BOOST_THROW_EXCEPTION(parse_error("unexpected end of document inside <" + m_elements.back().name + ">"));
     }
 
-    void get_graphs(const boost::property_tree::ptree& top,
-                           size_t desired_idx /* or -1 for all */, bool is_root,
-                           std::vector<const boost::property_tree::ptree*>& result) {
-      using boost::property_tree::ptree;
-      size_t current_idx = 0;
-      bool is_first = is_root;
-      BOOST_FOREACH(const ptree::value_type& n, top) {
-        if (n.first == "graph") {
-          if (current_idx == desired_idx || desired_idx == (size_t)(-1)) {
-            result.push_back(&n.second);
-            if(is_first)
-            {
-              is_first = false;
-              BOOST_FOREACH(const ptree::value_type& attr, n.second) {
-                if (attr.first != "data") 
-                  continue;
-                std::string key = attr.second.get<std::string>(path("<xmlattr>/key"));
-                std::string value = attr.second.get_value("");
-                handle_graph_property(key, value);
-              }
-            }
-            
-            get_graphs(n.second, (size_t)(-1), false, result);
-            if (desired_idx != (size_t)(-1)) break;
-          }
-          ++current_idx;
+private:
+    /// The kinds of keys. Not all of these are supported
+    enum key_kind {
+        graph_key,
+        node_key,
+        edge_key,
+        hyperedge_key,
+        port_key,
+        endpoint_key,
+        all_key,
+        graphml_key
+    };
+
+    struct element
+    {
+        std::string name;
+        // Whether the nodes and edges inside are read (see desired_idx).
+        bool active;
+        bool directed;
+    };
+
+    // Tokenizer.
+
+    bool starts_with(const char* s) const
+    {
+      size_t n = strlen(s);
+      return size_t(m_end - m_it) >= n && memcmp(m_it, s, n) == 0;
+    }
+
+    const char* find_char(char c) const
+    {
+      const char* p = static_cast<const char*>(memchr(m_it, c, m_end - m_it));
+      return p == 0 ? m_end : p;
+    }
+
+    void skip_past(const char* s)
+    {
+      size_t n = strlen(s);
+      while (m_it != m_end && !starts_with(s))
+        ++m_it;
+      if (m_it == m_end)
+        BOOST_THROW_EXCEPTION(parse_error(std::string("unterminated markup, expected ") + s));
+      m_it += n;
+    }
+
+    static bool is_space(char c)
+    {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+    }
+
+    void skip_spaces()
+    {
+      while (m_it != m_end && is_space(*m_it))
+        ++m_it;
+    }
+
+    void expect(char c)
+    {
+      if (m_it == m_end || *m_it != c)
+        BOOST_THROW_EXCEPTION(parse_error(std::string("malformed markup, expected '") + c + "'"));
+      ++m_it;
+    }
+
+    std::string read_name()
+    {
+      const char* begin = m_it;
+      while (m_it != m_end && !is_space(*m_it) && *m_it != '>' && *m_it != '/' && *m_it != '=')
+        ++m_it;
+      if (m_it == begin)
+        BOOST_THROW_EXCEPTION(parse_error("malformed markup, expected a name"));
+      return std::string(begin, m_it);
+    }
+
+    // Appends [begin, end) to out, replacing character and entity references.
+    static void decode(const char* begin, const char* end, std::string& out)
+    {
+      while (begin != end) {
+        const char* amp = static_cast<const char*>(memchr(begin, '&', end - begin));
+        if (amp == 0) {
+          out.append(begin, end);
+          return;
+        }
+        out.append(begin, amp);
+        const char* semi = static_cast<const char*>(memchr(amp, ';', end - amp));
+        if (semi == 0)
+          BOOST_THROW_EXCEPTION(parse_error("unterminated entity reference"));
+        std::string entity(amp + 1, semi);
+        if (entity == "lt") out += '<';
+        else if (entity == "gt") out += '>';
+        else if (entity == "amp") out += '&';
+        else if (entity == "quot") out += '"';
+        else if (entity == "apos") out += '\'';
+        else if (entity.size() > 1 && entity[0] == '#') {
+          unsigned long c = entity[1] == 'x'
+            ? strtoul(entity.c_str() + 2, 0, 16)
+            : strtoul(entity.c_str() + 1, 0, 10);
+          append_utf8(c, out);
         }
+        else BOOST_THROW_EXCEPTION(parse_error("unknown entity &" + entity + ";"));
+        begin = semi + 1;
+      }
+    }
+
+    static void append_utf8(unsigned long c, std::string& out)
+    {
+      if (c < 0x80) {
+        out += char(c);
+      } else if (c < 0x800) {
+        out += char(0xC0 | (c >> 6));
+        out += char(0x80 | (c & 0x3F));
+      } else if (c < 0x10000) {
+        out += char(0xE0 | (c >> 12));
+        out += char(0x80 | ((c >> 6) & 0x3F));
+        out += char(0x80 | (c & 0x3F));
+      } else {
+        out += char(0xF0 | (c >> 18));
+        out += char(0x80 | ((c >> 12) & 0x3F));
+        out += char(0x80 | ((c >> 6) & 0x3F));
+        out += char(0x80 | (c & 0x3F));
       }
     }
-    
-    void run(std::istream& in, size_t desired_idx)
+
+    // Reads the attributes and the end of a start tag.
+    void start_element()
     {
-      using boost::property_tree::ptree;
-      ptree pt;
-      read_xml(in, pt, boost::property_tree::xml_parser::no_comments | boost::property_tree::xml_parser::trim_whitespace);
-      ptree gml = pt.get_child(path("graphml"));
-      // Search for attributes
-      BOOST_FOREACH(const ptree::value_type& child, gml) {
-        if (child.first != "key") continue;
-        std::string id = child.second.get(path("<xmlattr>/id"), "");
-        std::string for_ = child.second.get(path("<xmlattr>/for"), "");
-        std::string name = child.second.get(path("<xmlattr>/attr.name"), "");
-        std::string type = child.second.get(path("<xmlattr>/attr.type"), "");
+      std::string name = read_name();
+      m_attributes.clear();
+      while (true) {
+        skip_spaces();
+        if (m_it == m_end)
+          BOOST_THROW_EXCEPTION(parse_error("unterminated tag <" + name + ">"));
+        if (*m_it == '>' || *m_it == '/')
+          break;
+        std::string key = read_name();
+        skip_spaces();
+        expect('=');
+        skip_spaces();
+        if (m_it == m_end || (*m_it != '"' && *m_it != '\''))
+          BOOST_THROW_EXCEPTION(parse_error("unquoted value of attribute " + key));
+        char quote = *m_it++;
+        const char* value_end = find_char(quote);
+        if (value_end == m_end)
+          BOOST_THROW_EXCEPTION(parse_error("unterminated value of attribute " + key));
+        std::string value;
+        decode(m_it, value_end, value);
+        m_attributes.push_back(std::make_pair(key, value));
+        m_it = value_end + 1;
+      }
+      bool empty = *m_it == '/';
+      if (empty)
+        ++m_it;
+      expect('>');
+      open_element(name);
+      if (empty)
+        end_element(name);
+    }
+
+    const std::string& attribute(const char* key, const std::string& default_value = std::string()) const
+    {
+      for (size_t i = 0; i < m_attributes.size(); ++i) {
+        if (m_attributes[i].first == key)
+          return m_attributes[i].second;
+      }
+      return default_value;
+    }
+
+    const std::string& required_attribute(const char* key, const std::string& name) const
+    {
+      static const std::string missing("\x01");
+      const std::string& value = attribute(key, missing);
+      if (&value == &missing)
+        BOOST_THROW_EXCEPTION(parse_error("<" + name + "> has no attribute " + key));
+      return value;
+    }
+
+    // GraphML structure.
+
+    bool in_data() const
+    {
+      return !m_elements.empty() && (m_elements.back().name == "data" || m_elements.back().name == "default");
+    }
+
+    const element* parent() const
+    {
+      return m_elements.empty() ? 0 : &m_elements.back();
+    }
+
+    void open_element(const std::string& name)
+    {
+      const element* up = parent();
+      element e;
+      e.name = name;
+      e.active = up != 0 && up->active;
+      e.directed = up != 0 && up->directed;
+      m_text.clear();
+
+      if (name == "graphml") {
+        e.active = false;
+      } else if (name == "key" && up != 0 && up->name == "graphml") {
+        m_key_id = attribute("id");
+        std::string for_ = attribute("for", "all");
         key_kind kind = all_key;
         if (for_ == "graph") kind = graph_key;
         else if (for_ == "node") kind = node_key;
@@ -86,171 +284,127 @@ public:
         else if (for_ == "all") kind = all_key;
         else if (for_ == "graphml") kind = graphml_key;
         else {BOOST_THROW_EXCEPTION(parse_error("Attribute for is not valid: " + for_));}
-        m_keys[id] = kind;
-        m_key_name[id] = name;
-        m_key_type[id] = type;
-        boost::optional<std::string> default_ = child.second.get_optional<std::string>(path("default"));
-        if (default_) m_key_default[id] = default_.get();
-      }
-
-      m_keys["id"] = node_key;
-      m_key_type["id"] = "string";
-      m_key_name["id"] = "id";
-      // Search for graphs
-      std::vector<const ptree*> graphs;
-      handle_graph();
-      get_graphs(gml, desired_idx, true, graphs);
-      BOOST_FOREACH(const ptree* gr, graphs) {
-        // Search for nodes
-        BOOST_FOREACH(const ptree::value_type& node, *gr) {
-          if (node.first != "node") continue;
-          std::string id = node.second.get<std::string>(path("<xmlattr>/id"));
-          handle_vertex(id);
-          BOOST_FOREACH(const ptree::value_type& attr, node.second) {
-            if (attr.first != "data") continue;
-            std::string key = attr.second.get<std::string>(path("<xmlattr>/key"));
-            std::string value = attr.second.get_value("");
-            handle_node_property(key, id, value);
-          }
+        m_keys[m_key_id] = kind;
+        m_key_name[m_key_id] = attribute("attr.name");
+      } else if (name == "graph") {
+        if (up != 0 && up->name == "graphml") {
+          // Top level graph: read it if it is the desired one.
+          e.active = m_graph_idx == m_desired_idx || m_desired_idx == (size_t)(-1);
+          ++m_graph_idx;
         }
-      }
-      BOOST_FOREACH(const ptree* gr, graphs) {
-        bool default_directed = gr->get<std::string>(path("<xmlattr>/edgedefault")) == "directed";
-        // Search for edges
-        BOOST_FOREACH(const ptree::value_type& edge, *gr) {
-          if (edge.first != "edge") continue;
-          std::string source = edge.second.get<std::string>(path("<xmlattr>/source"));
-          std::string target = edge.second.get<std::string>(path("<xmlattr>/target"));
-          std::string local_directed = edge.second.get(path("<xmlattr>/directed"), "");
-          bool is_directed = (local_directed == "" ? default_directed : local_directed == "true");
-          if (is_directed != m_g.is_directed()) {
-            if (is_directed) {
-              BOOST_THROW_EXCEPTION(directed_graph_error());
-            } else {
-              BOOST_THROW_EXCEPTION(undirected_graph_error());
-            }
-          }
-          size_t old_edges_size = m_edge.size();
-          handle_edge(source, target);
-          BOOST_FOREACH(const ptree::value_type& attr, edge.second) {
-            if (attr.first != "data") continue;
-            std::string key = attr.second.get<std::string>(path("<xmlattr>/key"));
-            std::string value = attr.second.get_value("");
-            handle_edge_property(key, old_edges_size, value);
+        e.directed = required_attribute("edgedefault", name) == "directed";
+      } else if (name == "node" && e.active) {
+        handle_vertex(required_attribute("id", name));
+      } else if (name == "edge" && e.active) {
+        std::string source = required_attribute("source", name);
+        std::string target = required_attribute("target", name);
+        std::string local_directed = attribute("directed");
+        bool is_directed = (local_directed == "" ? e.directed : local_directed == "true");
+        if (is_directed != m_builder->IsDirected()) {
+          if (is_directed) {
+            BOOST_THROW_EXCEPTION(directed_graph_error());
+          } else {
+            BOOST_THROW_EXCEPTION(undirected_graph_error());
           }
         }
+        handle_edge(source, target);
+      } else if (name == "data" && up != 0) {
+        m_data_key = required_attribute("key", name);
       }
+      m_elements.push_back(e);
     }
 
-private:
-    /// The kinds of keys. Not all of these are supported
-    enum key_kind { 
-        graph_key, 
-        node_key, 
-        edge_key,
-        hyperedge_key,
-        port_key,
-        endpoint_key, 
-        all_key,
-        graphml_key
-    };
-
-    void 
-    handle_vertex(const std::string& v)
+    void end_element(const std::string& name)
     {
-        bool is_new = m_vertex.find(v) == m_vertex.end();
-
-        if (is_new)
-        {
-            m_vertex[v] = m_g.do_add_vertex();
-            is_new = true;
-            std::map<std::string, std::string>::iterator iter;
-            for (iter = m_key_default.begin(); iter != m_key_default.end(); ++iter)
-            {
-                if (m_keys[iter->first] == node_key)
-                    handle_node_property(iter->first, v, iter->second);
-            }
-            handle_node_property("id", v, v);
-        }
+      if (m_elements.empty() || m_elements.back().name != name)
+        BOOST_THROW_EXCEPTION(parse_error("unexpected closing tag </" + name + ">"));
+      m_elements.pop_back();
+      const element* up = parent();
+      if (up == 0)
+        return;
+      if (name == "default" && up->name == "key") {
+        m_key_default[m_key_id] = m_text;
+      } else if (name == "data" && up->active && up->name == "edge") {
+        // Only edge weights are kept, other data is skipped.
+        handle_edge_property(m_data_key, m_edge, m_text);
+      }
+      m_text.clear();
     }
 
-    any
-    get_vertex_descriptor(const std::string& v)
+    // Vertex of id v, added to the builder on first sight. Integer ids are
+    // deduplicated by value.
+    gseq::VertexIndex
+    handle_vertex(const std::string& v)
     {
-      return m_vertex[v];
+        if (!m_builder->IntegerIds())
+            return m_builder->InternVertex(v);
+        int64 id;
+        if (!gseq::EdgeListReader::ParseInt64(v, &id))
+            BOOST_THROW_EXCEPTION(parse_error("node id \"" + v + "\" is not an integer"));
+        gseq::VertexIndex vertex = m_int_index.Find(id);
+        if (vertex < 0) {
+            vertex = m_builder->AddIntVertex(id);
+            m_int_index.Insert(id, vertex);
+        }
+        return vertex;
     }
 
-    void 
+    void
     handle_edge(const std::string& u, const std::string& v)
     {
-        handle_vertex(u);
-        handle_vertex(v);
-
-        any source, target;
-        source = get_vertex_descriptor(u);
-        target = get_vertex_descriptor(v);
-
-        any edge;
-        bool added;
-        boost::tie(edge, added) = m_g.do_add_edge(source, target);
-        if (!added) {
-            BOOST_THROW_EXCEPTION(bad_parallel_edge(u, v));
-        }
+        gseq::VertexIndex source = handle_vertex(u);
+        gseq::VertexIndex target = handle_vertex(v);
+        m_edge = m_builder->AddEdge(source, target);
 
-        size_t e = m_edge.size();
-        m_edge.push_back(edge);
-        
-        std::map<std::string, std::string>::iterator iter;
+        std::unordered_map<std::string, std::string>::iterator iter;
         for (iter = m_key_default.begin(); iter != m_key_default.end(); ++iter)
         {
             if (m_keys[iter->first] == edge_key)
-                handle_edge_property(iter->first, e, iter->second);
+                handle_edge_property(iter->first, m_edge, iter->second);
         }
     }
 
-    void 
-    handle_graph()
-    {
-      std::map<std::string, std::string>::iterator iter;
-      for (iter = m_key_default.begin(); iter != m_key_default.end(); ++iter)
-      {
-        if (m_keys[iter->first] == graph_key)
-          handle_graph_property(iter->first, iter->second);
-      }
-    }
-
-    void handle_graph_property(const std::string& key_id, const std::string& value)
+    void handle_edge_property(const std::string& key_id, int64 edge, const std::string& value)
     {
-      m_g.set_graph_property(m_key_name[key_id], value, m_key_type[key_id]);
+      if (!m_builder->HasWeights() || m_key_name[key_id] != m_weight_attr)
+        return;
+      float weight;
+      if (!gseq::EdgeListReader::ParseFloat(value, &weight))
+        BOOST_THROW_EXCEPTION(parse_error("invalid value \"" + value + "\" for key " + m_key_name[key_id]));
+      m_builder->SetEdgeWeight(edge, weight);
     }
 
-    void handle_node_property(const std::string& key_id, const std::string& descriptor, const std::string& value)
-    {
-      m_g.set_vertex_property(m_key_name[key_id], m_vertex[descriptor], value, m_key_type[key_id]);
-    }
+    gseq::GraphBuilder* m_builder;
+    std::string m_weight_attr;
+    const char* m_it;
+    const char* m_end;
+    size_t m_desired_idx;
+    size_t m_graph_idx = 0;
 
-    void handle_edge_property(const std::string& key_id, size_t descriptor, const std::string& value)
-    {
-      m_g.set_edge_property(m_key_name[key_id], m_edge[descriptor], value, m_key_type[key_id]);
-    }
+    std::vector<element> m_elements;
+    std::vector<std::pair<std::string, std::string> > m_attributes;
+    std::string m_text;
+    std::string m_key_id;
+    std::string m_data_key;
+    int64 m_edge = -1;
 
-    mutate_graph& m_g;
-    std::map<std::string, key_kind> m_keys;
-    std::map<std::string, std::string> m_key_name;
-    std::map<std::string, std::string> m_key_type;
-    std::map<std::string, std::string> m_key_default;
-    std::map<std::string, any> m_vertex;
-    std::vector<any> m_edge;
+    std::unordered_map<std::string, key_kind> m_keys;
+    std::unordered_map<std::string, std::string> m_key_name;
+    std::unordered_map<std::string, std::string> m_key_default;
+    // Vertices by id when the builder has integer ids, string ids are
+    // interned by the builder itself.
+    gseq::Int64IndexMap m_int_index;
 };
 
 }
 
-namespace boost
+namespace gseq
+{
+void
+parse_graphml(const char* data, size_t size, GraphBuilder* builder, const std::string& weight_attr,
+              size_t desired_idx)
 {
-void BOOST_GRAPH_DECL
-read_graphml(std::istream& in, mutate_graph& g, size_t desired_idx)
-{    
-    graphml_reader reader(g);
-    reader.run(in, desired_idx);
+    graphml_reader reader(builder, weight_attr);
+    reader.run(data, size, desired_idx);
 }
 }
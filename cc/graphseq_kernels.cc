@@ -13,12 +13,14 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 
+#include <cmath>
 #include <sstream>
 #include <unordered_set>
 #include <unordered_map>
 #include <iterator>
 #include <vector>
 #include <cassert>
+#include <limits>
 
 #include <iostream>
 
@@ -29,9 +31,6 @@ limitations under the License.
 #include "tensorflow/core/util/guarded_philox_random.h"
 
 
-#include <boost/graph/graphml.hpp>
-#include <boost/graph/adjacency_list.hpp>
-
 #include "sampling.h"
 #include "graph_kernel_base.h"
 #include "graphseq_kernels.h"
@@ -40,46 +39,59 @@ using namespace tensorflow;
 
 namespace gseq{
 
-Status Node2VecSeqOp::MakeGraphTypeAndInit(Env* env, const string& filename){
-    bool has_weight = HasWeights();
-    if(directed_){
-        typedef graph_types<true>::Graph Graph;
-        Graph graph;
-        return init_with_graph<Node2VecSeqOp, Graph>(this, env, filename, graph);
-    }
-    else{
-        typedef graph_types<false>::Graph Graph;
-        Graph graph;
-        return init_with_graph<Node2VecSeqOp, Graph>(this, env, filename, graph);
-    }
+Status Node2VecSeqOp::BuildGraph(Env* env, const string& filename){
+    return init_with_graph<Node2VecSeqOp>(this, env, filename);
 }
 
 
-void Node2VecSeqOp::PrecomputeWalk(int walk_idx, int start_node, random::SimplePhilox& gen){
-    // First sample start node
-    Alias a = node_alias_[start_node];
-    int from_node;
-    if(HasWeights()){
-        from_node = sample_alias(a, gen);
-    }
-    else{
-        auto i = gen.Uniform(a.idx.size());
-        from_node = a.idx[i];
-    }
+void Node2VecSeqOp::PrecomputeWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks){
+    (this->*walk_group_)(walks, gens, nb_walks);
+}
 
-    // Now sample using w2v distribution    
-    int prev_node = start_node;
-    auto w = precomputed_walks.matrix<int32>();
-    w(walk_idx, 0) = start_node;
-    w(walk_idx, 1) = from_node;
-    //w[1] = from_node;
-    for(int k=2; k < seq_size_; k++){
-        assert(edge_alias_[from_node].find(prev_node) != edge_alias_[from_node].end());
-        Alias* a = &(edge_alias_[from_node][prev_node]);
-        int next_node = sample_alias(*a, gen);
-        w(walk_idx, k) = (int32) next_node;
-        prev_node = from_node; from_node = next_node;
-    }
+
+template<bool Weighted, bool Compressed>
+void Node2VecSeqOp::Node2VecWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks){
+    auto step = [this, walks, gens, nb_walks](int k, VertexIndex* nodes){
+        VertexIndex cur_nodes[WALK_GROUP_SIZE];
+        for(int w=0; w<nb_walks; ++w)
+            cur_nodes[w] = walks[w][k-1];
+        if(k == 1){
+            sample_first_order<Weighted, Compressed>(node_alias_, cur_nodes, gens, nodes, nb_walks);
+            return;
+        }
+        // Walks whose pair has a table are sampled together, the others
+        // by rejection.
+        int lanes[WALK_GROUP_SIZE];
+        int64 starts[WALK_GROUP_SIZE];
+        int32 columns[WALK_GROUP_SIZE];
+        double draws[WALK_GROUP_SIZE];
+        int n = 0;
+        for(int w=0; w<nb_walks; ++w){
+            VertexIndex prev_node = walks[w][k-2];
+            VertexIndex from_node = cur_nodes[w];
+            int64 start = -1;
+            if(!edge_alias_.starts.empty())
+                start = edge_alias_start<Compressed>(node_alias_, edge_alias_, prev_node, from_node);
+            if(start < 0){
+                nodes[w] = sample_rejection<Weighted, Compressed>(node_alias_, bias_, prev_node, from_node, gens[w]);
+                continue;
+            }
+            lanes[n] = w;
+            starts[n] = start;
+            columns[n] = gens[w].Uniform(degree(node_alias_, from_node));
+            draws[n] = gens[w].RandDouble();
+            ++n;
+        }
+        select_alias(edge_alias_.probas.data(), edge_alias_.aliases.data(), starts, columns, draws, columns, n);
+        for(int i=0; i<n; ++i)
+            nodes[lanes[i]] = row_neighbor<Compressed>(node_alias_, cur_nodes[lanes[i]], columns[i]);
+    };
+    // The next step also reads the edge alias table starts of the node.
+    auto prefetch = [this](int w, VertexIndex node){
+        if(!edge_alias_.starts.empty())
+            port::prefetch<port::PREFETCH_HINT_T0>(&edge_alias_.starts[node_alias_.offsets[node]]);
+    };
+    interleaved_walks<Compressed>(node_alias_, walks, nb_walks, seq_size_, step, prefetch);
 }
 
 
@@ -91,50 +103,218 @@ Status Node2VecSeqOp::Init(Env* env, const string& filename) {
     if (seq_size_ < 2) {
         return errors::InvalidArgument("The sequence size must be greater than two");
     }
-    write_walk_idx = 0;
-    cur_walk_idx = 0;
+    bias_ = node2vec_bias(p_, q_);
+    TF_RETURN_IF_ERROR(LoadOrBuildGraph(env, filename));
+    if(IsFirstOrder() && is_compressed(node_alias_))
+        walk_group_ = HasWeights() ? &Node2VecSeqOp::FirstOrderWalkGroup<true, true> : &Node2VecSeqOp::FirstOrderWalkGroup<false, true>;
+    else if(IsFirstOrder())
+        walk_group_ = HasWeights() ? &Node2VecSeqOp::FirstOrderWalkGroup<true, false> : &Node2VecSeqOp::FirstOrderWalkGroup<false, false>;
+    else if(is_compressed(node_alias_))
+        walk_group_ = HasWeights() ? &Node2VecSeqOp::Node2VecWalkGroup<true, true> : &Node2VecSeqOp::Node2VecWalkGroup<false, true>;
+    else
+        walk_group_ = HasWeights() ? &Node2VecSeqOp::Node2VecWalkGroup<true, false> : &Node2VecSeqOp::Node2VecWalkGroup<false, false>;
+    return Status::OK();
+}
 
-    precomputed_walks = Tensor(DT_INT32, TensorShape({PRECOMPUTE, seq_size_}));
-    return MakeGraphTypeAndInit(env, filename);
+
+int64 Node2VecSeqOp::StepCost(){
+    // Rough cycles per step: an edge alias draw, or for rejection sampling
+    // a few first order draws each followed by a binary search for the
+    // common neighbor check.
+    if(IsFirstOrder())
+        return BaseGraphKernel::StepCost();
+    if(rejection_sampling_)
+        return 200;
+    return memory_budget_ < 0 ? 80 : 120;
 }
 
 
-std::vector<std::unordered_map<int, Alias>>* Node2VecSeqOp::getEdgeAlias(){
+EdgeAliasTable* Node2VecSeqOp::getEdgeAlias(){
     return &edge_alias_;
 }
 
 
-Status RandWalkSeq::MakeGraphTypeAndInit(Env* env, const string& filename){
-    bool has_weight = HasWeights();
-    if(directed_){
-      typedef graph_types<true>::Graph Graph;
-      Graph graph;
-      return init_with_graph<RandWalkSeq, Graph>(this, env, filename, graph);
+bool Node2VecSeqOp::IsFirstOrder(){
+    return p_ == 1 && q_ == 1;
+}
+
+
+string Node2VecSeqOp::SnapshotParameters(){
+    return strings::StrCat("Node2VecSeq ", BaseGraphKernel::SnapshotParameters(),
+                           " p=", p_, " q=", q_,
+                           " rejection_sampling=", static_cast<int>(rejection_sampling_),
+                           " memory_budget=", memory_budget_);
+}
+
+
+Status Node2VecSeqOp::WriteSnapshot(SnapshotWriter* writer){
+    TF_RETURN_IF_ERROR(BaseGraphKernel::WriteSnapshot(writer));
+    TF_RETURN_IF_ERROR(writer->WriteArray(edge_alias_.starts));
+    TF_RETURN_IF_ERROR(writer->WriteArray(edge_alias_.probas));
+    return writer->WriteArray(edge_alias_.aliases);
+}
+
+
+Status Node2VecSeqOp::ReadSnapshot(SnapshotReader* reader){
+    TF_RETURN_IF_ERROR(BaseGraphKernel::ReadSnapshot(reader));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&edge_alias_.starts));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&edge_alias_.probas));
+    TF_RETURN_IF_ERROR(reader->ReadArray(&edge_alias_.aliases));
+    // Tables are only built for second order walks without rejection
+    // sampling and with room for them, the walks then read starts for
+    // every edge.
+    if(rejection_sampling_ || IsFirstOrder() || !edge_alias_fits(node_alias_.offsets, memory_budget_)){
+        if(!edge_alias_.starts.empty() || !edge_alias_.probas.empty() || !edge_alias_.aliases.empty())
+            return errors::DataLoss("Snapshot ", snapshot_, " has edge alias tables the walks don't use");
+        return Status::OK();
     }
-    else{
-      typedef graph_types<false>::Graph Graph;
-      Graph graph;
-      return init_with_graph<RandWalkSeq, Graph>(this, env, filename, graph);
+    const std::vector<EdgeOffset>& offsets = node_alias_.offsets;
+    if(edge_alias_.starts.size() != static_cast<size_t>(offsets.back())
+       || edge_alias_.probas.size() != edge_alias_.aliases.size())
+        return errors::DataLoss("Snapshot ", snapshot_, " has ", edge_alias_.starts.size(),
+                                " edge alias tables for ", offsets.back(), " edges");
+    int64 nb_entries = edge_alias_.probas.size();
+    for(VertexIndex target=0; target+1<static_cast<VertexIndex>(offsets.size()); ++target){
+        int d = degree(node_alias_, target);
+        for(EdgeOffset e=offsets[target]; e<offsets[target+1]; ++e){
+            int64 start = edge_alias_.starts[e];
+            if(start == -1)
+                continue;
+            if(start < 0 || start + d > nb_entries)
+                return errors::DataLoss("Snapshot ", snapshot_, " has edge alias table ", start, " out of range");
+            for(int k=0; k<d; ++k){
+                if(edge_alias_.aliases[start+k] < 0 || edge_alias_.aliases[start+k] >= d)
+                    return errors::DataLoss("Snapshot ", snapshot_, " has alias ", edge_alias_.aliases[start+k],
+                                            " out of range");
+            }
+        }
     }
+    return Status::OK();
 }
 
 
-void RandWalkSeq::PrecomputeWalk(int walk_idx, int start_node, random::SimplePhilox& gen){
-  int node = start_node;
-  auto w = precomputed_walks.matrix<int32>();
-  w(walk_idx, 0) = start_node;
-  //w[1] = from_node;
-  for(int k=1; k < seq_size_; k++){
-    Alias a = node_alias_[node];
-    if(HasWeights()){
-      node = sample_alias(a, gen);
+Node2VecSkipGramOp::Node2VecSkipGramOp(OpKernelConstruction* ctx) : Node2VecSeqOp(ctx, false){
+    if(!ctx->status().ok())
+        return;
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("window_size", &window_size_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("dynamic_window", &dynamic_window_));
+    OP_REQUIRES_OK(ctx, ctx->GetAttr("num_negatives", &num_negatives_));
+    OP_REQUIRES(ctx, window_size_ > 0, errors::InvalidArgument("window_size must be positive"));
+    OP_REQUIRES(ctx, num_negatives_ >= 0, errors::InvalidArgument("num_negatives can't be negative"));
+    // Positions in the negative table are int32, like in the rows.
+    OP_REQUIRES(ctx, valid_nodes_.size() <= static_cast<size_t>(std::numeric_limits<int32>::max()),
+                errors::InvalidArgument("Negatives are drawn from at most 2^31 - 1 nodes, the graph has ",
+                                        valid_nodes_.size()));
+    SetupNegativeTable();
+    StartProducer(ctx->env());
+}
+
+
+void Node2VecSkipGramOp::SetupNegativeTable(){
+    // Summed in double, millions of small weights would lose their low
+    // bits in a float total.
+    double sum_weights = 0;
+    for(VertexIndex node : valid_nodes_){
+        float weight = std::pow(static_cast<float>(degree(node_alias_, node)), NEGATIVE_POWER);
+        negative_table_.idx.push_back(node);
+        negative_table_.probas.push_back(weight);
+        sum_weights += weight;
+    }
+    if(!negative_table_.idx.empty())
+        setup_alias_vectors(negative_table_, static_cast<float>(sum_weights));
+}
+
+
+void Node2VecSkipGramOp::Compute(OpKernelContext* ctx){
+    OP_REQUIRES(ctx, !valid_nodes_.empty(),
+                errors::FailedPrecondition("The graph has no node with outgoing edges"));
+    WalkBatch batch;
+    NextBatch(&batch);
+    const VertexIndex* walks = batch.walks.flat<VertexIndex>().data();
+    int64 nb_walks = batch.walks.dim_size(0);
+
+    // Examples are counted walk by walk, then written at their offsets.
+    // Both passes draw the same windows, from the stream of each walk.
+    std::vector<int64> offsets(nb_walks+1, 0);
+    int64 walk_cost = int64(seq_size_)*(2*window_size_ + 1)*(num_negatives_ + 1)*30;
+    auto count = [&](int64 start, int64 end){
+        for(int64 r=start; r<end; ++r)
+            offsets[r+1] = WalkExamples(walks + r*seq_size_, batch.first_walk + r, nullptr, nullptr, nullptr);
+    };
+    Shard(num_threads_, workers_, nb_walks, int64(seq_size_)*30, count);
+    for(int64 r=0; r<nb_walks; ++r)
+        offsets[r+1] += offsets[r];
+
+    int64 nb_examples = offsets[nb_walks];
+    Tensor centers(DT_VERTEX_INDEX, TensorShape({nb_examples}));
+    Tensor contexts(DT_VERTEX_INDEX, TensorShape({nb_examples}));
+    Tensor negatives(DT_VERTEX_INDEX, TensorShape({nb_examples, num_negatives_}));
+    VertexIndex* centers_data = centers.flat<VertexIndex>().data();
+    VertexIndex* contexts_data = contexts.flat<VertexIndex>().data();
+    VertexIndex* negatives_data = negatives.flat<VertexIndex>().data();
+    auto fill = [&](int64 start, int64 end){
+        for(int64 r=start; r<end; ++r)
+            WalkExamples(walks + r*seq_size_, batch.first_walk + r, centers_data + offsets[r],
+                         contexts_data + offsets[r], negatives_data + offsets[r]*num_negatives_);
+    };
+    Shard(num_threads_, workers_, nb_walks, walk_cost, fill);
+
+    ctx->set_output(0, node_id_);
+    ctx->set_output(1, centers);
+    ctx->set_output(2, contexts);
+    ctx->set_output(3, negatives);
+    SetCounterOutputs(ctx, 4);
+}
+
+
+int64 Node2VecSkipGramOp::WalkExamples(const VertexIndex* walk, int64 walk_idx, VertexIndex* centers, VertexIndex* contexts,
+                                       VertexIndex* negatives){
+    random::PhiloxRandom window_phi = WalkGenerator(walk_idx, WINDOW_STREAM_OFFSET);
+    random::SimplePhilox window_gen(&window_phi);
+    random::PhiloxRandom negative_phi = WalkGenerator(walk_idx, NEGATIVE_STREAM_OFFSET);
+    random::SimplePhilox negative_gen(&negative_phi);
+    int64 n = 0;
+    for(int i=0; i<seq_size_; ++i){
+        if(walk[i] < 0)
+            continue;
+        int span = window_size_;
+        if(dynamic_window_)
+            span = 1 + window_gen.Uniform(window_size_);
+        int end = std::min(seq_size_ - 1, i + span);
+        for(int j=std::max(0, i - span); j<=end; ++j){
+            if(j == i || walk[j] < 0)
+                continue;
+            if(centers != nullptr){
+                centers[n] = walk[i];
+                contexts[n] = walk[j];
+            }
+            ++n;
+        }
     }
-    else{
-      auto i = gen.Uniform(a.idx.size());
-      node = a.idx[i];
+    // The negatives of all the examples are drawn in batches from their own
+    // stream, as positions in the table first.
+    if(centers != nullptr && num_negatives_ > 0){
+        int64 nb_negatives = n*num_negatives_;
+        int32 positions[ALIAS_BATCH_SIZE];
+        for(int64 first=0; first<nb_negatives; first+=ALIAS_BATCH_SIZE){
+            int m = static_cast<int>(std::min<int64>(ALIAS_BATCH_SIZE, nb_negatives - first));
+            sample_alias(negative_table_.probas.data(), negative_table_.aliases.data(), negative_table_.idx.size(),
+                         negative_gen, positions, m);
+            for(int k=0; k<m; ++k)
+                negatives[first + k] = negative_table_.idx[positions[k]];
+        }
     }
-    w(walk_idx, k) = (int32) node;
-  }
+    return n;
+}
+
+
+Status RandWalkSeq::BuildGraph(Env* env, const string& filename){
+    return init_with_graph<RandWalkSeq>(this, env, filename);
+}
+
+
+void RandWalkSeq::PrecomputeWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks){
+  (this->*walk_group_)(walks, gens, nb_walks);
 }
 
 
@@ -142,18 +322,23 @@ Status RandWalkSeq::Init(Env* env, const string& filename) {
   if (seq_size_ < 2) {
     return errors::InvalidArgument("The sequence's size must be greater than two");
   }
-  write_walk_idx = 0;
-  cur_walk_idx = 0;
-  precomputed_walks = Tensor(DT_INT32, TensorShape({PRECOMPUTE, seq_size_}));
-  return MakeGraphTypeAndInit(env, filename);
+  TF_RETURN_IF_ERROR(LoadOrBuildGraph(env, filename));
+  if(is_compressed(node_alias_))
+    walk_group_ = HasWeights() ? &RandWalkSeq::FirstOrderWalkGroup<true, true> : &RandWalkSeq::FirstOrderWalkGroup<false, true>;
+  else
+    walk_group_ = HasWeights() ? &RandWalkSeq::FirstOrderWalkGroup<true, false> : &RandWalkSeq::FirstOrderWalkGroup<false, false>;
+  return Status::OK();
 }
 
-// template<> Status init_with_graph<RandWalkSeq, typename graph_types<true>::Graph>;
-// template<> Status init_with_graph<RandWalkSeq, typename graph_types<false>::Graph>;
 
+string RandWalkSeq::SnapshotParameters(){
+  return strings::StrCat("RandWalkSeq ", BaseGraphKernel::SnapshotParameters());
+}
 
 REGISTER_KERNEL_BUILDER(Name("RandWalkSeq").Device(DEVICE_CPU), RandWalkSeq);
 
 REGISTER_KERNEL_BUILDER(Name("Node2VecSeq").Device(DEVICE_CPU), Node2VecSeqOp);
 
+REGISTER_KERNEL_BUILDER(Name("Node2VecSkipGram").Device(DEVICE_CPU), Node2VecSkipGramOp);
+
 } // Namespace
\ No newline at end of file
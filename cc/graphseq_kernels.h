@@ -15,141 +15,176 @@
 
 namespace gseq{
 
+const float NEGATIVE_POWER = 0.75;
+
 
 class Node2VecSeqOp : public BaseGraphKernel {
 public:
-    explicit Node2VecSeqOp(OpKernelConstruction* ctx) : BaseGraphKernel(ctx){
+    explicit Node2VecSeqOp(OpKernelConstruction* ctx) : Node2VecSeqOp(ctx, true){ }
+
+    ~Node2VecSeqOp() override {
+        StopProducer();
+    }
+
+    EdgeAliasTable* getEdgeAlias();
+    // With p == q == 1 node2vec walks are first order walks, no edge alias
+    // table is built.
+    bool IsFirstOrder();
+
+    float p_ = 1.;
+    float q_ = 1.;
+    bool rejection_sampling_ = false;
+    int64 memory_budget_ = -1;
+protected:
+    // The producer thread calls virtual methods, so only the most derived
+    // constructor starts it, once the object is complete.
+    Node2VecSeqOp(OpKernelConstruction* ctx, bool start_producer) : BaseGraphKernel(ctx){
+        if(!ctx->status().ok())
+            return;
         OP_REQUIRES_OK(ctx, ctx->GetAttr("p", &p_));
         OP_REQUIRES_OK(ctx, ctx->GetAttr("q", &q_));
+        OP_REQUIRES_OK(ctx, ctx->GetAttr("rejection_sampling", &rejection_sampling_));
+        OP_REQUIRES_OK(ctx, ctx->GetAttr("memory_budget", &memory_budget_));
+        if(memory_budget_ == 0)
+            rejection_sampling_ = true;
         string filename;
         OP_REQUIRES_OK(ctx, ctx->GetAttr("filename", &filename));
         OP_REQUIRES_OK(ctx, Init(ctx->env(), filename));
+        if(start_producer)
+            StartProducer(ctx->env());
     }
 
-    std::vector<std::unordered_map<int, Alias>>* getEdgeAlias();
-
-    float p_ = 1.;
-    float q_ = 1.;
 private:
-    std::vector<std::unordered_map<int, Alias>> edge_alias_;
+    EdgeAliasTable edge_alias_;
+    // Biases of the rejection sampler, for the pairs without a table.
+    Node2VecBias bias_;
+    template<bool Weighted, bool Compressed>
+    void Node2VecWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks);
+    // Walk group generator picked in Init for the weights, the row layout
+    // and p, q.
+    void (Node2VecSeqOp::*walk_group_)(VertexIndex* const*, random::SimplePhilox*, int) = nullptr;
 protected:
     virtual Status Init(Env* env, const string& filename);
-    virtual Status MakeGraphTypeAndInit(Env* env, const string& filename);
-    virtual void PrecomputeWalk(int walk_idx, int start_node, random::SimplePhilox& gen);
+    virtual Status BuildGraph(Env* env, const string& filename);
+    virtual void PrecomputeWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks);
+    virtual int64 StepCost();
+    virtual string SnapshotParameters();
+    virtual Status WriteSnapshot(SnapshotWriter* writer);
+    virtual Status ReadSnapshot(SnapshotReader* reader);
 };
 
 
 
+// Node2vec walks turned into skip-gram examples: every (center, context)
+// pair of nodes at most a window apart in a walk, each with num_negatives_
+// nodes drawn from the unigram distribution raised to NEGATIVE_POWER. Node
+// frequencies in the walks are estimated by their degree.
+class Node2VecSkipGramOp : public Node2VecSeqOp {
+public:
+    explicit Node2VecSkipGramOp(OpKernelConstruction* ctx);
+
+    // Stops the producer before the members of this class are destroyed.
+    ~Node2VecSkipGramOp() override {
+        StopProducer();
+    }
+
+    void Compute(OpKernelContext* ctx) override;
+
+private:
+    void SetupNegativeTable();
+    // Writes the examples of a walk from centers, contexts and negatives
+    // on, or only counts them when centers is null. Returns their number.
+    int64 WalkExamples(const VertexIndex* walk, int64 walk_idx, VertexIndex* centers, VertexIndex* contexts,
+                       VertexIndex* negatives);
+
+    int32 window_size_ = 5;
+    bool dynamic_window_ = true;
+    int32 num_negatives_ = 5;
+    Alias negative_table_;
+};
+
+
 class RandWalkSeq : public BaseGraphKernel {
 public:
     explicit RandWalkSeq(OpKernelConstruction* ctx)
       : BaseGraphKernel(ctx){
+        if(!ctx->status().ok())
+            return;
         string filename;
         OP_REQUIRES_OK(ctx, ctx->GetAttr("filename", &filename));
         OP_REQUIRES_OK(ctx, Init(ctx->env(), filename));
+        StartProducer(ctx->env());
+    }
+
+    ~RandWalkSeq() override {
+        StopProducer();
     }
 
 protected:
     virtual Status Init(Env* env, const string& filename);
-    virtual Status MakeGraphTypeAndInit(Env* env, const string& filename);
-    virtual void PrecomputeWalk(int walk_idx, int start_node, random::SimplePhilox& gen);
-
+    virtual Status BuildGraph(Env* env, const string& filename);
+    virtual void PrecomputeWalkGroup(VertexIndex* const* walks, random::SimplePhilox* gens, int nb_walks);
+    virtual string SnapshotParameters();
+private:
+    void (RandWalkSeq::*walk_group_)(VertexIndex* const*, random::SimplePhilox*, int) = nullptr;
 };
 
 
-template<typename T, typename G> struct AliasStructureSetter{
-    void Setup(T* kernel, G& graph);
+template<typename T> struct AliasStructureSetter{
+    void Setup(T* kernel, const CSRGraph& csr);
 };
 
 
-template<typename G>
-struct AliasStructureSetter<Node2VecSeqOp, G>{
+template<>
+struct AliasStructureSetter<Node2VecSeqOp>{
 
-    void Setup(Node2VecSeqOp* kernel, G &graph){
+    void Setup(Node2VecSeqOp* kernel, const CSRGraph& csr){
         auto edge_alias = kernel->getEdgeAlias();
         auto node_alias = kernel->getNodeAlias();
         auto valid_nodes = kernel->getValidNodes();
-        setup_node_alias(graph, *node_alias, *valid_nodes, kernel->HasWeights());
-        int total_entries = 0;
-        int32 nb_vertices = static_cast<int32>(boost::num_vertices(graph));
-        edge_alias->resize(nb_vertices);
-        for(int target=0; target<nb_vertices; ++target){
-            if(target % 1000 == 0)
-                std::cout << target << "/" << nb_vertices << std::endl;
-            typename G::adjacency_iterator vit, vend;
-            typename G::adjacency_iterator sit, send;
-            std::tie(vit, vend) = boost::adjacent_vertices(target, graph);
-            std::unordered_map<int, Alias>& nmap = (*edge_alias)[target];
-
-            for(auto source_it = vit; source_it != vend; ++source_it){
-                std::unordered_set<int> source_neighbors;
-                int source = *source_it;
-                std::tie(sit, send) = boost::adjacent_vertices(source, graph);
-                source_neighbors.insert(sit, send);
-                float sum_weights=0;
-                for(auto it = vit; it != vend; ++it){
-                    float weight = 1.;
-                    if(kernel->HasWeights()){
-                        auto e = boost::edge(*vit,*it, graph).first;
-                        weight = graph[e].weight;
-                    }
-                    if(*it == source)
-                        weight *= 1./kernel->p_;
-                    else{
-                        auto prev_neigh = source_neighbors.find(*it);
-                        if(prev_neigh == source_neighbors.end())
-                            weight *= 1./kernel->q_;
-                    }
-                    sum_weights += weight;
-                    nmap[source].probas.push_back(weight);
-                    nmap[source].idx.push_back(*it);
-
-                    total_entries += 1;
-                }
-                setup_alias_vectors(nmap[source], sum_weights);
-            }
-        }
+        setup_node_alias(csr, *node_alias, *valid_nodes, kernel->HasWeights(), kernel->CompressAdjacency());
+        if(kernel->rejection_sampling_ || kernel->IsFirstOrder())
+            return;
+        int64 nb_precomputed = setup_edge_alias(csr, *edge_alias, kernel->p_, kernel->q_, kernel->HasWeights(),
+                                                kernel->memory_budget_, kernel->getWorkers(), kernel->getNumThreads());
+        std::cout << "precomputed " << nb_precomputed << "/" << csr.offsets.back() << " edge alias tables" << std::endl;
     }  
 };
 
 
-template<typename G>
-struct AliasStructureSetter<RandWalkSeq, G>{
-    void Setup(RandWalkSeq* kernel, G &graph){
+template<>
+struct AliasStructureSetter<RandWalkSeq>{
+    void Setup(RandWalkSeq* kernel, const CSRGraph& csr){
         auto node_alias = kernel->getNodeAlias();
         auto valid_nodes = kernel->getValidNodes();
-        setup_node_alias(graph, *node_alias, *valid_nodes, kernel->HasWeights());
+        setup_node_alias(csr, *node_alias, *valid_nodes, kernel->HasWeights(), kernel->CompressAdjacency());
     }
   
 };
 
 
-template<typename T, typename G> Status init_with_graph(T* kernel, Env* env, const string& filename, G& graph){
-    boost::dynamic_properties dp(boost::ignore_other_properties);
-    dp.property("id", boost::get(&VertexProperty::id, graph));
-    if(kernel->HasWeights()){
-        dp.property(kernel->getWeightAttrName(), boost::get(&EdgeProperty::weight, graph));
-    }
-    // std::cout << "Reading the graph" << std::endl;
+// Reads the graph straight into a CSRGraph, without an intermediate boost
+// graph, renumbers its vertices to the order of the kernel, fills the node
+// ids of the kernel from the intern table of the builder and hands the
+// graph to the alias setup of the kernel.
+template<typename T> Status init_with_graph(T* kernel, Env* env, const string& filename){
     std::clock_t begin = std::clock();
-    read_graph(env, filename, graph, dp, kernel->HasWeights(), kernel->getWeightAttrName());
+    GraphBuilder builder(kernel->IsDirected(), kernel->HasWeights(), kernel->IntegerIds());
+    TF_RETURN_IF_ERROR(read_graph(env, filename, &builder, kernel->getWeightAttrName(),
+                                  kernel->getWorkers(), kernel->getNumThreads()));
+    VertexIndex nb_vertices = builder.NumVertices();
+    int64 nb_edges = builder.NumEdges();
+    kernel->InitNodeId(nb_vertices);
+    CSRGraph csr;
+    TF_RETURN_IF_ERROR(builder.Finalize(&csr, kernel->getReorder(), &kernel->getNodeId(),
+                                        kernel->getWorkers(), kernel->getNumThreads()));
     std::clock_t end = std::clock();
     double elapsed_secs = double(end - begin) / CLOCKS_PER_SEC;
     cout << "successfully read graph in " << elapsed_secs << " seconds." << endl;
-    int32 nb_vertices = static_cast<int32>(boost::num_vertices(graph));
-    int32 nb_edges = static_cast<int32>(boost::num_edges(graph));
-    kernel->InitNodeId(nb_vertices);
     std::cout << "nb vertices: " << nb_vertices << " nb edges " << nb_edges << std::endl;
 
-    Tensor& node_id = kernel->getNodeId();
-    for(int i=0; i<nb_vertices; ++i){
-        node_id.flat<string>()(i) = graph[i].id;
-    }
-
-    AliasStructureSetter<T, G> setter;
-    setter.Setup(kernel, graph);
-    // graph_size_ = nb_vertices;
-    graph.clear();
+    AliasStructureSetter<T> setter;
+    setter.Setup(kernel, csr);
     return Status::OK();
 }
 
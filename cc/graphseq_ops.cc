@@ -13,14 +13,15 @@ See the License for the specific language governing permissions and
 limitations under the License.
 ==============================================================================*/
 #include "tensorflow/core/framework/op.h"
+#include "graph_index.h"
 
 
 REGISTER_OP("RandWalkSeq")
-    .Output("node_id: string")
-    .Output("walks: int32")
-    .Output("nb_seqs_per_node: int32")
-    .Output("nb_seqs: int32")
-    .Output("nb_valid_nodes: int32")
+    .Output("node_id: id_type")
+    .Output("walks: " GSEQ_VERTEX_INDEX_TYPE)
+    .Output("nb_seqs_per_node: int64")
+    .Output("nb_seqs: int64")
+    .Output("nb_valid_nodes: int64")
     .SetIsStateful()
     .Attr("filename: string")
     .Attr("size: int = 40")
@@ -28,51 +29,153 @@ REGISTER_OP("RandWalkSeq")
     .Attr("weights_attribute: string = 'weight'")
     .Attr("has_weights: bool = false")
     .Attr("batchsize: int = 128")
+    .Attr("num_batches: int = 1")
+    .Attr("snapshot: string = ''")
+    .Attr("seed: int = 0")
+    .Attr("seed2: int = 0")
+    .Attr("subsample: float = 0")
+    .Attr("reorder: string = 'none'")
+    .Attr("id_type: {string, int64} = DT_STRING")
+    .Attr("compress_adjacency: bool = false")
     .Doc(R"doc(
 Parses a graph representation in graphml format and produces sequences of nodes
 following a simple random walk process.
 
 
-node_id: A vector of words in the corpus.
-walks: The total number of walks produced so far.
+node_id: A vector of words in the corpus, the node ids of the graph.
+walks: A [num_batches * batchsize, size] matrix of node indices, one walk per row. Rows end with -1 when nodes are subsampled. Node indices are int32, or int64 when the library is built with -DGSEQ_INT64_VERTICES.
 nb_seqs_per_node: The minimal number of walks produced so far. This is can be seen as the epoch.
 nb_seqs: The total number of sequences that have been generated thus far;
 filename: The path of the graphml file containing the graph.
 size: The size of the walks to generate.
+batchsize: The number of walks in a batch.
+num_batches: The number of batches returned by each call, to save session round-trips on small batches.
 directed: is the graph directed.
 weights_attribute: when reading a graph in graphml format this is the name of the edge property that contains the weight.
+snapshot: path of a binary snapshot of the preprocessed graph. It is loaded instead of filename when it exists, and written after preprocessing otherwise.
+seed: if either seed or seed2 is set to be non-zero, the walks are deterministic: the k-th walk only depends on the seeds and on k. Otherwise, a random seed is used.
+seed2: a second seed to avoid seed collision.
+subsample: word2vec subsampling threshold of frequent nodes, 0 to keep every node. A node of frequency f (its share of the degrees) is kept with probability (sqrt(f / subsample) + 1) * subsample / f. Kept nodes are moved to the front of the walk, which is padded with -1.
+reorder: renumbering of the nodes after reading the graph, to improve the memory locality of the walks: 'none' keeps the file order, 'degree' sorts the nodes by decreasing degree, 'rcm' uses the reverse Cuthill-McKee order. node_id follows the new order.
+id_type: type of node_id. With int64, node ids must be integers: they are parsed as numbers while reading the graph and no string is allocated.
+compress_adjacency: store the neighbors of each node delta encoded as varints, in blocks with a skip table so that a neighbor is read without decoding the whole row. Uses less memory than the int32 (or int64) neighbor array, most of it on unweighted graphs, for somewhat slower steps. The walks are the same either way.
 )doc");
 
 
 REGISTER_OP("Node2VecSeq")
-    .Output("node_id: string")
-    .Output("walks: int32")
-    .Output("nb_seqs_per_node: int32")
-    .Output("nb_seqs: int32")
-    .Output("nb_valid_nodes: int32")
+    .Output("node_id: id_type")
+    .Output("walks: " GSEQ_VERTEX_INDEX_TYPE)
+    .Output("nb_seqs_per_node: int64")
+    .Output("nb_seqs: int64")
+    .Output("nb_valid_nodes: int64")
     .SetIsStateful()
     .Attr("filename: string")
     .Attr("size: int = 40")
     .Attr("p: float = 0.5")
     .Attr("q: float = 0.5")
+    .Attr("rejection_sampling: bool = false")
+    .Attr("memory_budget: int = -1")
     .Attr("weights_attribute: string = 'weight'")
     .Attr("has_weights: bool = false")
     .Attr("directed: bool = false")
     .Attr("batchsize: int = 128")
+    .Attr("num_batches: int = 1")
+    .Attr("snapshot: string = ''")
+    .Attr("seed: int = 0")
+    .Attr("seed2: int = 0")
+    .Attr("subsample: float = 0")
+    .Attr("reorder: string = 'none'")
+    .Attr("id_type: {string, int64} = DT_STRING")
+    .Attr("compress_adjacency: bool = false")
+    .Doc(R"doc(
+Parses a graph representation in graphml format and produces sequences of nodes
+following the node2vec random walk process.
+
+
+node_id: A vector of words in the corpus, the node ids of the graph.
+walks: A [num_batches * batchsize, size] matrix of node indices, one walk per row. Rows end with -1 when nodes are subsampled. Node indices are int32, or int64 when the library is built with -DGSEQ_INT64_VERTICES.
+nb_seqs_per_node: The minimal number of walks produced so far. This is can be seen as the epoch.
+nb_seqs: The total number of sequences that have been generated thus far;
+filename: The path of the graphml file containing the graph.
+size: The size of the walks to generate.
+batchsize: The number of walks in a batch.
+num_batches: The number of batches returned by each call, to save session round-trips on small batches.
+p: node2vec p parameter.
+q: node2vec q parameter.
+rejection_sampling: sample each step from the first order distribution and accept it according to the p/q bias instead of precomputing second order alias tables. Uses O(E) memory.
+memory_budget: maximum number of bytes used by the second order alias tables, negative for no limit. It includes 8 bytes per edge to locate the tables, and no table is built when that leaves no room for one. Tables are precomputed for the lowest degree nodes first and the remaining steps use rejection sampling. 0 is the same as rejection_sampling.
+directed: is the graph directed.
+weights_attribute: when reading a graph in graphml format this is the name of the edge property that contains the weight.
+snapshot: path of a binary snapshot of the preprocessed graph. It is loaded instead of filename when it exists, and written after preprocessing otherwise.
+seed: if either seed or seed2 is set to be non-zero, the walks are deterministic: the k-th walk only depends on the seeds and on k. Otherwise, a random seed is used.
+seed2: a second seed to avoid seed collision.
+subsample: word2vec subsampling threshold of frequent nodes, 0 to keep every node. A node of frequency f (its share of the degrees) is kept with probability (sqrt(f / subsample) + 1) * subsample / f. Kept nodes are moved to the front of the walk, which is padded with -1.
+reorder: renumbering of the nodes after reading the graph, to improve the memory locality of the walks: 'none' keeps the file order, 'degree' sorts the nodes by decreasing degree, 'rcm' uses the reverse Cuthill-McKee order. node_id follows the new order.
+id_type: type of node_id. With int64, node ids must be integers: they are parsed as numbers while reading the graph and no string is allocated.
+compress_adjacency: store the neighbors of each node delta encoded as varints, in blocks with a skip table so that a neighbor is read without decoding the whole row. Uses less memory than the int32 (or int64) neighbor array, most of it on unweighted graphs, for somewhat slower steps. The walks are the same either way.
+)doc");
+
+
+REGISTER_OP("Node2VecSkipGram")
+    .Output("node_id: id_type")
+    .Output("center: " GSEQ_VERTEX_INDEX_TYPE)
+    .Output("context: " GSEQ_VERTEX_INDEX_TYPE)
+    .Output("negatives: " GSEQ_VERTEX_INDEX_TYPE)
+    .Output("nb_seqs_per_node: int64")
+    .Output("nb_seqs: int64")
+    .Output("nb_valid_nodes: int64")
+    .SetIsStateful()
+    .Attr("filename: string")
+    .Attr("size: int = 40")
+    .Attr("p: float = 0.5")
+    .Attr("q: float = 0.5")
+    .Attr("rejection_sampling: bool = false")
+    .Attr("memory_budget: int = -1")
+    .Attr("weights_attribute: string = 'weight'")
+    .Attr("has_weights: bool = false")
+    .Attr("directed: bool = false")
+    .Attr("batchsize: int = 128")
+    .Attr("num_batches: int = 1")
+    .Attr("snapshot: string = ''")
+    .Attr("window_size: int = 5")
+    .Attr("dynamic_window: bool = true")
+    .Attr("num_negatives: int = 5")
+    .Attr("seed: int = 0")
+    .Attr("seed2: int = 0")
+    .Attr("subsample: float = 0")
+    .Attr("reorder: string = 'none'")
+    .Attr("id_type: {string, int64} = DT_STRING")
+    .Attr("compress_adjacency: bool = false")
     .Doc(R"doc(
 Parses a graph representation in graphml format and produces batches of examples
 created using skipgram sampling on walks generated using the node2vec random
 walk process.
 
 
-node_id: A vector of words in the corpus.
-walks: The total number of walks produced so far.
+node_id: A vector of words in the corpus, the node ids of the graph.
+center: The center node of each example. Node indices are int32, or int64 when the library is built with -DGSEQ_INT64_VERTICES.
+context: The context node of each example, at most window_size steps away from center in a walk.
+negatives: A [nb_examples, num_negatives] matrix of nodes drawn from the unigram distribution (estimated by the degree) raised to the power 0.75.
 nb_seqs_per_node: The minimal number of walks produced so far. This is can be seen as the epoch.
 nb_seqs: The total number of sequences that have been generated thus far;
 filename: The path of the graphml file containing the graph.
 size: The size of the walks to generate.
+batchsize: The number of walks in a batch.
+num_batches: The number of batches returned by each call, to save session round-trips on small batches.
 p: node2vec p parameter.
 q: node2vec q parameter.
+rejection_sampling: sample each step from the first order distribution and accept it according to the p/q bias instead of precomputing second order alias tables. Uses O(E) memory.
+memory_budget: maximum number of bytes used by the second order alias tables, negative for no limit. It includes 8 bytes per edge to locate the tables, and no table is built when that leaves no room for one. Tables are precomputed for the lowest degree nodes first and the remaining steps use rejection sampling. 0 is the same as rejection_sampling.
 directed: is the graph directed.
 weights_attribute: when reading a graph in graphml format this is the name of the edge property that contains the weight.
+snapshot: path of a binary snapshot of the preprocessed graph. It is loaded instead of filename when it exists, and written after preprocessing otherwise.
+seed: if either seed or seed2 is set to be non-zero, the walks are deterministic: the k-th walk only depends on the seeds and on k. Otherwise, a random seed is used.
+seed2: a second seed to avoid seed collision.
+subsample: word2vec subsampling threshold of frequent nodes, 0 to keep every node. A node of frequency f (its share of the degrees) is kept with probability (sqrt(f / subsample) + 1) * subsample / f. Kept nodes are moved to the front of the walk, which is padded with -1.
+reorder: renumbering of the nodes after reading the graph, to improve the memory locality of the walks: 'none' keeps the file order, 'degree' sorts the nodes by decreasing degree, 'rcm' uses the reverse Cuthill-McKee order. node_id follows the new order.
+id_type: type of node_id. With int64, node ids must be integers: they are parsed as numbers while reading the graph and no string is allocated.
+compress_adjacency: store the neighbors of each node delta encoded as varints, in blocks with a skip table so that a neighbor is read without decoding the whole row. Uses less memory than the int32 (or int64) neighbor array, most of it on unweighted graphs, for somewhat slower steps. The walks are the same either way.
+window_size: maximum distance between the center and context nodes of an example.
+dynamic_window: draw the window of every center node uniformly in [1, window_size], as word2vec does.
+num_negatives: number of negative nodes drawn for each example.
 )doc");
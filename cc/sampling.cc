@@ -1,4 +1,8 @@
 #include <iostream>
+#include <algorithm>
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
 #include "sampling.h"
 
 using namespace std;
@@ -6,16 +10,13 @@ using namespace std;
 namespace gseq{
 
 
-void setup_alias_vectors(Alias& alias, float norm){
-    int N = alias.probas.size();
-    assert(alias.probas.size() == alias.idx.size());
-    alias.aliases.resize(N);
+void setup_alias_vectors(float* probas, int32* aliases, int N, float norm){
     std::queue<int> big;
     std::queue<int> small;
     float f = N/norm;
     for(int i=0; i<N; i++){
-        alias.probas[i] = alias.probas[i]*f;
-        if(alias.probas[i] < 1.)
+        probas[i] = probas[i]*f;
+        if(probas[i] < 1.)
           small.push(i);
         else
           big.push(i);
@@ -23,9 +24,9 @@ void setup_alias_vectors(Alias& alias, float norm){
     while(!(big.empty() || small.empty())){
         int s = small.front(); small.pop();
         int b = big.front(); big.pop();
-        alias.aliases[s] = b;
-        float ptot = alias.probas[s] + alias.probas[b] - 1.;
-        alias.probas[b] = ptot;
+        aliases[s] = b;
+        float ptot = probas[s] + probas[b] - 1.;
+        probas[b] = ptot;
         if(ptot < 1.){
             small.push(b);
         }
@@ -36,17 +37,183 @@ void setup_alias_vectors(Alias& alias, float norm){
 }
 
 
-int sample_alias(Alias& alias, random::SimplePhilox& gen){
+void setup_alias_vectors(Alias& alias, float norm){
     int N = alias.probas.size();
+    assert(alias.probas.size() == alias.idx.size());
+    alias.aliases.resize(N);
+    setup_alias_vectors(alias.probas.data(), alias.aliases.data(), N, norm);
+}
+
+
+int sample_alias(const float* probas, const int32* aliases, int N, random::SimplePhilox& gen){
     int v = gen.Uniform(N);
     double x = gen.RandDouble();
-    if(x < alias.probas[v]){
-        return alias.idx[v];
+    if(x < probas[v]){
+        return v;
     }
-    return alias.idx[alias.aliases[v]];
+    return aliases[v];
 }
 
 
+VertexIndex sample_alias(Alias& alias, random::SimplePhilox& gen){
+    int N = alias.probas.size();
+    return alias.idx[sample_alias(alias.probas.data(), alias.aliases.data(), N, gen)];
+}
+
+
+void select_alias(const float* probas, const int32* aliases, const int64* starts,
+                  const int32* columns, const double* draws, int32* out, int n){
+    int i = 0;
+#ifdef __AVX2__
+    for(; i+4<=n; i+=4){
+        __m128i cols = _mm_loadu_si128(reinterpret_cast<const __m128i*>(columns + i));
+        __m256i pos = _mm256_cvtepi32_epi64(cols);
+        if(starts != nullptr)
+            pos = _mm256_add_epi64(pos, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(starts + i)));
+        __m256d p = _mm256_cvtps_pd(_mm256_i64gather_ps(probas, pos, 4));
+        __m256d below = _mm256_cmp_pd(_mm256_loadu_pd(draws + i), p, _CMP_LT_OQ);
+        __m128i alias = _mm256_i64gather_epi32(aliases, pos, 4);
+        // Narrow the 64 bit lanes of the mask to 32 bits.
+        __m256 mask = _mm256_castpd_ps(below);
+        __m128 mask32 = _mm_shuffle_ps(_mm256_castps256_ps128(mask), _mm256_extractf128_ps(mask, 1),
+                                       _MM_SHUFFLE(2, 0, 2, 0));
+        __m128i picked = _mm_blendv_epi8(alias, cols, _mm_castps_si128(mask32));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), picked);
+    }
+#endif
+    for(; i<n; ++i){
+        int64 pos = (starts != nullptr ? starts[i] : 0) + columns[i];
+        out[i] = draws[i] < probas[pos] ? columns[i] : aliases[pos];
+    }
+}
+
+
+void sample_alias(const float* probas, const int32* aliases, int N, random::SimplePhilox& gen, int32* out, int n){
+    int32 columns[ALIAS_BATCH_SIZE];
+    double draws[ALIAS_BATCH_SIZE];
+    for(int first=0; first<n; first+=ALIAS_BATCH_SIZE){
+        int m = std::min(ALIAS_BATCH_SIZE, n - first);
+        // Random numbers are drawn in the order of sample_alias.
+        for(int i=0; i<m; ++i){
+            columns[i] = gen.Uniform(N);
+            draws[i] = gen.RandDouble();
+        }
+        select_alias(probas, aliases, nullptr, columns, draws, out + first, m);
+    }
+}
+
+
+template<bool Weighted, bool Compressed>
+void sample_first_order(const AliasTable& table, const VertexIndex* nodes, random::SimplePhilox* gens, VertexIndex* out, int n){
+    if(!Weighted){
+        for(int i=0; i<n; ++i)
+            out[i] = sample_uniform<Compressed>(table, nodes[i], gens[i]);
+        return;
+    }
+    int64 starts[ALIAS_BATCH_SIZE];
+    int32 columns[ALIAS_BATCH_SIZE];
+    double draws[ALIAS_BATCH_SIZE];
+    for(int first=0; first<n; first+=ALIAS_BATCH_SIZE){
+        int m = std::min(ALIAS_BATCH_SIZE, n - first);
+        for(int i=0; i<m; ++i){
+            VertexIndex node = nodes[first + i];
+            starts[i] = table.offsets[node];
+            columns[i] = gens[first + i].Uniform(degree(table, node));
+            draws[i] = gens[first + i].RandDouble();
+        }
+        select_alias(table.probas.data(), table.aliases.data(), starts, columns, draws, columns, m);
+        for(int i=0; i<m; ++i)
+            out[first + i] = row_neighbor<Compressed>(table, nodes[first + i], columns[i]);
+    }
+}
+
+template void sample_first_order<true, false>(const AliasTable&, const VertexIndex*, random::SimplePhilox*, VertexIndex*, int);
+template void sample_first_order<false, false>(const AliasTable&, const VertexIndex*, random::SimplePhilox*, VertexIndex*, int);
+template void sample_first_order<true, true>(const AliasTable&, const VertexIndex*, random::SimplePhilox*, VertexIndex*, int);
+template void sample_first_order<false, true>(const AliasTable&, const VertexIndex*, random::SimplePhilox*, VertexIndex*, int);
+
+
+void sample_first_order(const AliasTable& table, const VertexIndex* nodes, bool weighted,
+                        random::SimplePhilox* gens, VertexIndex* out, int n){
+    if(is_compressed(table)){
+        if(weighted)
+            sample_first_order<true, true>(table, nodes, gens, out, n);
+        else
+            sample_first_order<false, true>(table, nodes, gens, out, n);
+    }
+    else if(weighted)
+        sample_first_order<true, false>(table, nodes, gens, out, n);
+    else
+        sample_first_order<false, false>(table, nodes, gens, out, n);
+}
+
+
+template<bool Compressed>
+bool has_neighbor(const AliasTable& table, VertexIndex node, VertexIndex neighbor){
+    if(Compressed)
+        return compressed_position(table.compressed, node, degree(table, node), neighbor) >= 0;
+    auto begin = table.idx.begin() + table.offsets[node];
+    auto end = table.idx.begin() + table.offsets[node+1];
+    return std::binary_search(begin, end, neighbor);
+}
+
+
+template<bool Compressed>
+int neighbor_position(const AliasTable& table, VertexIndex node, VertexIndex neighbor){
+    if(Compressed)
+        return compressed_position(table.compressed, node, degree(table, node), neighbor);
+    auto begin = table.idx.begin() + table.offsets[node];
+    auto end = table.idx.begin() + table.offsets[node+1];
+    auto it = std::lower_bound(begin, end, neighbor);
+    if(it == end || *it != neighbor)
+        return -1;
+    return it - begin;
+}
+
+template bool has_neighbor<true>(const AliasTable&, VertexIndex, VertexIndex);
+template bool has_neighbor<false>(const AliasTable&, VertexIndex, VertexIndex);
+template int neighbor_position<true>(const AliasTable&, VertexIndex, VertexIndex);
+template int neighbor_position<false>(const AliasTable&, VertexIndex, VertexIndex);
+
+
+bool has_neighbor(const AliasTable& table, VertexIndex node, VertexIndex neighbor){
+    return is_compressed(table) ? has_neighbor<true>(table, node, neighbor) : has_neighbor<false>(table, node, neighbor);
+}
+
+
+int neighbor_position(const AliasTable& table, VertexIndex node, VertexIndex neighbor){
+    return is_compressed(table) ? neighbor_position<true>(table, node, neighbor)
+                                : neighbor_position<false>(table, node, neighbor);
+}
+
+
+Node2VecBias node2vec_bias(float p, float q){
+    Node2VecBias bias;
+    bias.return_bias = 1./p;
+    bias.out_bias = 1./q;
+    bias.max_bias = std::max(1.f, std::max(bias.return_bias, bias.out_bias));
+    bias.min_bias = std::min(1.f, std::min(bias.return_bias, bias.out_bias));
+    return bias;
+}
+
+
+template<bool Weighted, bool Compressed>
+VertexIndex sample_rejection(const AliasTable& table, const Node2VecBias& bias, VertexIndex prev_node,
+                             VertexIndex cur_node, random::SimplePhilox& gen){
+    while(true){
+        VertexIndex candidate = sample_first_order<Weighted, Compressed>(table, cur_node, gen);
+        float y = gen.RandFloat()*bias.max_bias;
+        if(accept_candidate<Compressed>(table, bias, prev_node, candidate, y))
+            return candidate;
+    }
+}
+
+template VertexIndex sample_rejection<true, false>(const AliasTable&, const Node2VecBias&, VertexIndex, VertexIndex, random::SimplePhilox&);
+template VertexIndex sample_rejection<true, true>(const AliasTable&, const Node2VecBias&, VertexIndex, VertexIndex, random::SimplePhilox&);
+template VertexIndex sample_rejection<false, false>(const AliasTable&, const Node2VecBias&, VertexIndex, VertexIndex, random::SimplePhilox&);
+template VertexIndex sample_rejection<false, true>(const AliasTable&, const Node2VecBias&, VertexIndex, VertexIndex, random::SimplePhilox&);
+
+
 void print_alias(Alias& alias){
     cout << "idx: ";
     for(auto x: alias.idx){
@@ -6,7 +6,10 @@
 
 #include "tensorflow/core/lib/random/philox_random.h"
 #include "tensorflow/core/lib/random/simple_philox.h"
+#include "tensorflow/core/platform/prefetch.h"
 #include "tensorflow/core/util/guarded_philox_random.h"
+#include "compressed_rows.h"
+#include "graph_index.h"
 
 using namespace tensorflow;
 
@@ -16,16 +19,250 @@ namespace gseq{
 typedef struct Alias {
     std::vector<float> probas;
     std::vector<int> aliases;
-    std::vector<int> idx;
+    std::vector<VertexIndex> idx;
 } Alias;
 
 
+// Alias tables of every node stored in compressed sparse row layout. The
+// neighbors of node i are idx[offsets[i]:offsets[i+1]]. For weighted graphs,
+// probas and aliases are parallel to idx and aliases hold positions relative
+// to the start of the row; for unweighted graphs they stay empty and
+// neighbors are drawn uniformly. When the adjacency is compressed, the rows
+// are in compressed and idx is empty; row_neighbor reads either.
+typedef struct AliasTable {
+    std::vector<EdgeOffset> offsets;
+    std::vector<VertexIndex> idx;
+    std::vector<float> probas;
+    std::vector<int32> aliases;
+    CompressedRows compressed;
+} AliasTable;
+
+
+// Second order alias tables of node2vec, stored flat. The table of the pair
+// (target, source), where source is the j-th neighbor of target in an
+// AliasTable, starts at starts[offsets[target]+j] and has one entry per
+// neighbor of target; the sampled neighbor is read back from the row of
+// target. starts is -1 for pairs that have no table.
+typedef struct EdgeAliasTable {
+    std::vector<int64> starts;
+    std::vector<float> probas;
+    std::vector<int32> aliases;
+} EdgeAliasTable;
+
+
+void setup_alias_vectors(float* probas, int32* aliases, int N, float norm);
+
 void setup_alias_vectors(Alias& alias, float norm);
 
-int sample_alias(Alias& alias, random::SimplePhilox& gen);
+int sample_alias(const float* probas, const int32* aliases, int N, random::SimplePhilox& gen);
+
+VertexIndex sample_alias(Alias& alias, random::SimplePhilox& gen);
+
+// Second half of sample_alias on n tables at once: out[i] is columns[i] if
+// draws[i] is below its probability in the table starting at starts[i] (at
+// 0 when starts is null), and its alias otherwise. The probabilities and
+// aliases are gathered 4 tables at a time when built with AVX2.
+void select_alias(const float* probas, const int32* aliases, const int64* starts,
+                  const int32* columns, const double* draws, int32* out, int n);
+
+// Same samples as n calls to sample_alias(probas, aliases, N, gen).
+void sample_alias(const float* probas, const int32* aliases, int N, random::SimplePhilox& gen, int32* out, int n);
+
+// Same samples as sample_first_order(table, nodes[i], weighted, gens[i]) for
+// every i < n.
+template<bool Weighted, bool Compressed>
+void sample_first_order(const AliasTable& table, const VertexIndex* nodes, random::SimplePhilox* gens, VertexIndex* out, int n);
+
+void sample_first_order(const AliasTable& table, const VertexIndex* nodes, bool weighted,
+                        random::SimplePhilox* gens, VertexIndex* out, int n);
+
+// A row holds fewer than 2^31 entries, only the offsets need 64 bits.
+inline int degree(const AliasTable& table, VertexIndex node){
+    return static_cast<int>(table.offsets[node+1] - table.offsets[node]);
+}
+
+inline bool is_compressed(const AliasTable& table){
+    return !table.compressed.starts.empty();
+}
+
+// The functions reading rows take the layout of the table as their
+// Compressed parameter, so that the walk loops, which pick it once, don't
+// test it at every step. The overloads without it test is_compressed, for
+// the setup code.
+
+// k-th neighbor of node.
+template<bool Compressed>
+inline VertexIndex row_neighbor(const AliasTable& table, VertexIndex node, int k){
+    if(!Compressed)
+        return table.idx[table.offsets[node] + k];
+    return compressed_neighbor(table.compressed, node, degree(table, node), k);
+}
+
+inline VertexIndex row_neighbor(const AliasTable& table, VertexIndex node, int k){
+    return is_compressed(table) ? row_neighbor<true>(table, node, k) : row_neighbor<false>(table, node, k);
+}
+
+template<bool Compressed>
+inline VertexIndex sample_alias(const AliasTable& table, VertexIndex node, random::SimplePhilox& gen){
+    EdgeOffset start = table.offsets[node];
+    int v = sample_alias(&table.probas[start], &table.aliases[start], degree(table, node), gen);
+    return row_neighbor<Compressed>(table, node, v);
+}
+
+inline VertexIndex sample_alias(const AliasTable& table, VertexIndex node, random::SimplePhilox& gen){
+    return is_compressed(table) ? sample_alias<true>(table, node, gen) : sample_alias<false>(table, node, gen);
+}
+
+template<bool Compressed>
+inline VertexIndex sample_uniform(const AliasTable& table, VertexIndex node, random::SimplePhilox& gen){
+    return row_neighbor<Compressed>(table, node, gen.Uniform(degree(table, node)));
+}
+
+inline VertexIndex sample_uniform(const AliasTable& table, VertexIndex node, random::SimplePhilox& gen){
+    return is_compressed(table) ? sample_uniform<true>(table, node, gen) : sample_uniform<false>(table, node, gen);
+}
+
+template<bool Weighted, bool Compressed>
+inline VertexIndex sample_first_order(const AliasTable& table, VertexIndex node, random::SimplePhilox& gen){
+    return Weighted ? sample_alias<Compressed>(table, node, gen) : sample_uniform<Compressed>(table, node, gen);
+}
+
+inline VertexIndex sample_first_order(const AliasTable& table, VertexIndex node, bool weighted, random::SimplePhilox& gen){
+    return weighted ? sample_alias(table, node, gen) : sample_uniform(table, node, gen);
+}
+
+// Rows of the table are sorted, so these are binary searches.
+template<bool Compressed>
+bool has_neighbor(const AliasTable& table, VertexIndex node, VertexIndex neighbor);
+
+bool has_neighbor(const AliasTable& table, VertexIndex node, VertexIndex neighbor);
+
+// Position of neighbor in the row of node, or -1 if they are not adjacent.
+template<bool Compressed>
+int neighbor_position(const AliasTable& table, VertexIndex node, VertexIndex neighbor);
+
+int neighbor_position(const AliasTable& table, VertexIndex node, VertexIndex neighbor);
+
+// Start of the table of the step following prev_node -> cur_node in
+// edge_table, or -1 if that pair has no table.
+template<bool Compressed>
+inline int64 edge_alias_start(const AliasTable& table, const EdgeAliasTable& edge_table, VertexIndex prev_node,
+                              VertexIndex cur_node){
+    int j = neighbor_position<Compressed>(table, cur_node, prev_node);
+    if(j < 0)
+        return -1;
+    return edge_table.starts[table.offsets[cur_node] + j];
+}
+
+inline int64 edge_alias_start(const AliasTable& table, const EdgeAliasTable& edge_table, VertexIndex prev_node,
+                              VertexIndex cur_node){
+    return is_compressed(table) ? edge_alias_start<true>(table, edge_table, prev_node, cur_node)
+                                : edge_alias_start<false>(table, edge_table, prev_node, cur_node);
+}
+
+
+// Biases of a node2vec step from cur_node: 1/p to return to the previous
+// node, 1 to a neighbor of the previous node and 1/q to any other node,
+// with their bounds.
+typedef struct Node2VecBias {
+    float return_bias = 1.;
+    float out_bias = 1.;
+    float min_bias = 1.;
+    float max_bias = 1.;
+} Node2VecBias;
+
+Node2VecBias node2vec_bias(float p, float q);
+
+// Rejection test of the node2vec step prev_node -> cur_node -> candidate,
+// candidate being drawn from the first order distribution of cur_node and y
+// uniformly in [0, bias.max_bias): the candidate is accepted when y is below
+// its bias. Below bias.min_bias that holds for any candidate, so the
+// neighbor search is skipped.
+template<bool Compressed>
+inline bool accept_candidate(const AliasTable& table, const Node2VecBias& bias, VertexIndex prev_node,
+                             VertexIndex candidate, float y){
+    if(y < bias.min_bias)
+        return true;
+    if(candidate == prev_node)
+        return y < bias.return_bias;
+    if(has_neighbor<Compressed>(table, prev_node, candidate))
+        return y < 1.;
+    return y < bias.out_bias;
+}
+
+// Samples the node2vec step following prev_node -> cur_node by drawing
+// first order candidates until one is accepted. Used for the pairs that
+// have no edge alias table.
+template<bool Weighted, bool Compressed>
+VertexIndex sample_rejection(const AliasTable& table, const Node2VecBias& bias, VertexIndex prev_node,
+                             VertexIndex cur_node, random::SimplePhilox& gen);
 
 void print_alias(Alias& alias);
 
+
+// Number of walks advanced in lockstep by interleaved_walks.
+const int WALK_GROUP_SIZE = 16;
+// Number of samples the batched samplers draw at once.
+const int ALIAS_BATCH_SIZE = 64;
+
+inline void prefetch_row_bounds(const AliasTable& table, VertexIndex node){
+    port::prefetch<port::PREFETCH_HINT_T0>(&table.offsets[node]);
+}
+
+template<bool Compressed>
+inline void prefetch_row(const AliasTable& table, VertexIndex node){
+    EdgeOffset start = table.offsets[node];
+    if(Compressed)
+        port::prefetch<port::PREFETCH_HINT_T0>(table.compressed.bytes.data() + table.compressed.starts[node]);
+    else
+        port::prefetch<port::PREFETCH_HINT_T0>(table.idx.data() + start);
+    if(!table.probas.empty()){
+        port::prefetch<port::PREFETCH_HINT_T0>(table.probas.data() + start);
+        port::prefetch<port::PREFETCH_HINT_T0>(table.aliases.data() + start);
+    }
+}
+
+
+// Fills walks[0..nb_walks) up to size nodes, walks[w][0] being set. Walking
+// a large graph one walk at a time stalls on a cache miss at every step, as
+// each step reads the row of the node drawn by the previous one. The walks
+// are advanced one step at a time instead: a first pass draws the next node
+// of every walk and prefetches its row bounds, a second pass reads them and
+// prefetches the rows, so the misses of the nb_walks walks overlap.
+// step(k, nodes) draws nodes[w] = walks[w][k] for every walk, which lets it
+// batch the draws; prefetch(w, node) prefetches whatever else step reads
+// about node. Compressed is the layout of table.
+template<bool Compressed, typename Step, typename Prefetch>
+void interleaved_walks(const AliasTable& table, VertexIndex* const* walks, int nb_walks, int size,
+                       Step step, Prefetch prefetch){
+    VertexIndex nodes[WALK_GROUP_SIZE];
+    for(int w=0; w<nb_walks; ++w)
+        prefetch_row_bounds(table, walks[w][0]);
+    for(int w=0; w<nb_walks; ++w){
+        prefetch_row<Compressed>(table, walks[w][0]);
+        prefetch(w, walks[w][0]);
+    }
+    for(int k=1; k<size; ++k){
+        step(k, nodes);
+        for(int w=0; w<nb_walks; ++w){
+            walks[w][k] = nodes[w];
+            prefetch_row_bounds(table, nodes[w]);
+        }
+        if(k+1 == size)
+            break;
+        for(int w=0; w<nb_walks; ++w){
+            prefetch_row<Compressed>(table, nodes[w]);
+            prefetch(w, nodes[w]);
+        }
+    }
+}
+
+
+template<bool Compressed, typename Step>
+void interleaved_walks(const AliasTable& table, VertexIndex* const* walks, int nb_walks, int size, Step step){
+    interleaved_walks<Compressed>(table, walks, nb_walks, size, step, [](int w, VertexIndex node){});
+}
+
 } // Namespace
 
 #endif  // SAMPLING_H
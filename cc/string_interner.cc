@@ -0,0 +1,45 @@
+#include <algorithm>
+#include <cstring>
+
+#include "string_interner.h"
+
+namespace gseq{
+
+namespace {
+
+const size_t ARENA_BLOCK_SIZE = 1 << 20;
+
+}
+
+
+VertexIndex StringArena::Add(StringPiece s){
+    strings_.push_back(Copy(s));
+    return static_cast<VertexIndex>(strings_.size()) - 1;
+}
+
+
+void StringArena::Clear(){
+    std::vector<std::unique_ptr<char[]>>().swap(blocks_);
+    std::vector<StringPiece>().swap(strings_);
+    block_free_ = 0;
+    block_end_ = nullptr;
+}
+
+
+StringPiece StringArena::Copy(StringPiece s){
+    if(s.empty())
+        return StringPiece();
+    if(s.size() > block_free_){
+        // Strings longer than a block get a block of their own.
+        size_t size = std::max(ARENA_BLOCK_SIZE, s.size());
+        blocks_.emplace_back(new char[size]);
+        block_end_ = blocks_.back().get() + size;
+        block_free_ = size;
+    }
+    char* data = block_end_ - block_free_;
+    memcpy(data, s.data(), s.size());
+    block_free_ -= s.size();
+    return StringPiece(data, s.size());
+}
+
+} // Namespace
@@ -0,0 +1,125 @@
+#ifndef STRING_INTERNER_H
+#define STRING_INTERNER_H
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "tensorflow/core/lib/core/stringpiece.h"
+#include "tensorflow/core/platform/types.h"
+#include "graph_index.h"
+
+using namespace tensorflow;
+
+namespace gseq{
+
+struct StringPieceHash {
+    size_t operator()(StringPiece s) const {
+        // FNV-1a
+        uint64 h = 14695981039346656037ULL;
+        for(char c : s){
+            h ^= static_cast<unsigned char>(c);
+            h *= 1099511628211ULL;
+        }
+        return h;
+    }
+};
+
+
+// Append-only storage of strings. Strings are copied back to back into
+// large blocks that never move, so a string costs its bytes plus one
+// StringPiece instead of a heap allocated std::string each.
+class StringArena {
+public:
+    VertexIndex Add(StringPiece s);
+    StringPiece operator[](VertexIndex i) const {return strings_[i];}
+    VertexIndex size() const {return static_cast<VertexIndex>(strings_.size());}
+    void Clear();
+
+private:
+    StringPiece Copy(StringPiece s);
+
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t block_free_ = 0;
+    char* block_end_ = nullptr;
+    std::vector<StringPiece> strings_;
+};
+
+
+// Open addressing hash set of the strings of an array, giving the index of
+// a string in the array. Slots hold the index and 32 bits of the hash of
+// their string, so that probes only compare strings when the hashes match.
+// The strings themselves are not copied: the array is passed to every call,
+// which lets it move (e.g. a vector of StringPieces) as long as its content
+// does not change. Strings is anything with a StringPiece
+// operator[](VertexIndex).
+template<typename Strings>
+class StringInterner {
+public:
+    static uint64 Hash(StringPiece s){return StringPieceHash()(s);}
+
+    // Index of s in strings, or -1 if it was not inserted.
+    VertexIndex Find(const Strings& strings, StringPiece s, uint64 hash) const {
+        if(slots_.empty())
+            return -1;
+        return slots_[Probe(strings, s, hash)].index;
+    }
+
+    // Indexes strings[index], which hashes to hash and must not be in the
+    // set yet.
+    void Insert(const Strings& strings, VertexIndex index, uint64 hash){
+        if(2*(size_ + 1) > slots_.size())
+            Grow(strings);
+        Slot& slot = slots_[Probe(strings, strings[index], hash)];
+        slot.index = index;
+        slot.tag = Tag(hash);
+        ++size_;
+    }
+
+    void Clear(){
+        std::vector<Slot>().swap(slots_);
+        size_ = 0;
+    }
+
+private:
+    struct Slot {
+        VertexIndex index = -1;
+        uint32 tag = 0;
+    };
+
+    static uint32 Tag(uint64 hash){return static_cast<uint32>(hash >> 32);}
+
+    // Slot of s, or the free slot where it would go.
+    size_t Probe(const Strings& strings, StringPiece s, uint64 hash) const {
+        size_t mask = slots_.size() - 1;
+        uint32 tag = Tag(hash);
+        for(size_t i = hash & mask; ; i = (i + 1) & mask){
+            const Slot& slot = slots_[i];
+            if(slot.index < 0 || (slot.tag == tag && strings[slot.index] == s))
+                return i;
+        }
+    }
+
+    void Grow(const Strings& strings){
+        std::vector<Slot> slots(std::max<size_t>(16, 2*slots_.size()));
+        slots.swap(slots_);
+        for(const Slot& slot : slots){
+            if(slot.index < 0)
+                continue;
+            // The strings are distinct, only the free slot is searched for.
+            size_t mask = slots_.size() - 1;
+            uint64 hash = Hash(strings[slot.index]);
+            size_t i = hash & mask;
+            while(slots_[i].index >= 0)
+                i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<Slot> slots_;
+    size_t size_ = 0;
+};
+
+} // Namespace
+
+#endif // STRING_INTERNER_H
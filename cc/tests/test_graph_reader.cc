@@ -1,83 +1,330 @@
 #include <iostream>
 #include <fstream>
+#include <cstdio>
 #include <cassert>
+#include <sstream>
+#include <algorithm>
+#include <iterator>
 
 #include "graph_reader.h"
 #include "graph_kernel_base.h"
 
 using namespace gseq;
 
-typedef typename graph_types<true>::Graph DGraph;
-typedef typename graph_types<false>::Graph Graph;
+// Graph as read by the kernels: CSR adjacency plus vertex ids.
+struct ReadGraph {
+    CSRGraph csr;
+    std::vector<string> ids;
+    int64 nb_edges = 0;
+};
 
 
-template<typename G>
-boost::dynamic_properties read_graph(std::string fname, G& g, bool graphml, bool has_weight, std::string wname){
+// Builds g as the kernels do, the ids going through the id tensor.
+void finalize(GraphBuilder& builder, ReadGraph& g, thread::ThreadPool* workers = nullptr, int num_threads = 1){
+    g.nb_edges = builder.NumEdges();
+    Tensor ids(DT_STRING, TensorShape({builder.NumVertices()}));
+    TF_CHECK_OK(builder.Finalize(&g.csr, "none", &ids, workers, num_threads));
+    g.ids.resize(ids.NumElements());
+    for(size_t i=0; i<g.ids.size(); i++)
+        g.ids[i] = ids.flat<string>()(i);
+}
+
+
+// Same with integer ids.
+std::vector<int64> finalize_int_ids(GraphBuilder& builder, CSRGraph* csr){
+    Tensor ids(DT_INT64, TensorShape({builder.NumVertices()}));
+    TF_CHECK_OK(builder.Finalize(csr, "none", &ids));
+    std::vector<int64> result(ids.NumElements());
+    for(size_t i=0; i<result.size(); i++)
+        result[i] = ids.flat<int64>()(i);
+    return result;
+}
+
+
+void read_graph(std::string fname, ReadGraph& g, bool graphml, bool directed, bool has_weight, std::string wname){
     std::ifstream fin(fname);
-    boost::dynamic_properties dp(boost::ignore_other_properties);
-    dp.property("id", boost::get(&VertexProperty::id, g));
-    if(has_weight){
-        dp.property(wname, boost::get(&EdgeProperty::weight, g));
+    GraphBuilder builder(directed, has_weight);
+    if(graphml){
+        std::string data((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+        TF_CHECK_OK(gseq::read_graphml(data.data(), data.size(), &builder, wname));
     }
-    if(graphml)
-        gseq::read_graphml(fin, g, dp);
-    else
-        gseq::read_edgelist(fin, g, dp, has_weight, wname);
-    return dp;
+    else{
+        TF_CHECK_OK(gseq::read_edgelist(fin, &builder));
+    }
+    finalize(builder, g);
 }
 
-template<typename G>
-boost::dynamic_properties read_graph(std::string fname, G& g, bool graphml){
-    return read_graph(fname, g, graphml, false, "");
+void read_graph(std::string fname, ReadGraph& g, bool graphml, bool directed){
+    read_graph(fname, g, graphml, directed, false, "");
 }
 
 
-template<typename G>
-void test_nb_vertices_edges(G& g, int nbv, int nbe){
-    int32 nb_vertices = static_cast<int32>(boost::num_vertices(g));
-    int32 nb_edges = static_cast<int32>(boost::num_edges(g));
+void test_nb_vertices_edges(ReadGraph& g, int nbv, int nbe){
+    int64 nb_vertices = g.ids.size();
+    int64 nb_edges = g.nb_edges;
     cout << nb_vertices << " " << nb_edges << endl;
     assert(nb_vertices == nbv && nb_edges == nbe);
+    assert(static_cast<int64>(g.csr.offsets.size()) == nbv + 1);
+}
+
+
+// Weight of the first source -> target entry of the adjacency, -1 if none.
+float edge_weight(ReadGraph& g, int source, int target){
+    for(EdgeOffset k=g.csr.offsets[source]; k<g.csr.offsets[source+1]; k++){
+        if(g.csr.neighbors[k] == target)
+            return g.csr.weights.empty() ? 1. : g.csr.weights[k];
+    }
+    return -1;
 }
 
+
 void test_read_graphml(){
-    Graph g;
-    read_graph("../../data/miserables.graphml", g, true);
+    ReadGraph g;
+    read_graph("../../data/miserables.graphml", g, true, false);
     test_nb_vertices_edges(g, 77, 254);
     cout << "test read graphml ok" << endl;
 }
 
 
+Status read_graphml_buffer(const string& s, ReadGraph& g, bool directed){
+    GraphBuilder builder(directed, true);
+    Status status = gseq::read_graphml(s.data(), s.size(), &builder, "weight");
+    finalize(builder, g);
+    return status;
+}
+
+void test_read_graphml_buffer(){
+    string s =
+        "<?xml version=\"1.0\"?>\n"
+        "<!-- comment with <tags> -->\n"
+        "<graphml xmlns=\"http://graphml.graphdrawing.org/xmlns\">\n"
+        "  <key id=\"w\" for=\"edge\" attr.name=\"weight\" attr.type=\"float\"><default>2.5</default></key>\n"
+        "  <graph id=\"G\" edgedefault=\"undirected\">\n"
+        "    <node id=\"a&amp;b\"/>\n"
+        "    <node id='c'></node>\n"
+        "    <edge source=\"a&amp;b\" target=\"c\"><data key=\"w\"><![CDATA[1.5]]></data></edge>\n"
+        "    <edge source=\"c\" target=\"d&#x41;\"/>\n"
+        "  </graph>\n"
+        "</graphml>\n";
+    ReadGraph g;
+    TF_CHECK_OK(read_graphml_buffer(s, g, false));
+    test_nb_vertices_edges(g, 3, 2);
+    assert(g.ids[0] == "a&b" && g.ids[1] == "c" && g.ids[2] == "dA");
+    assert(edge_weight(g, 0, 1) == 1.5f && edge_weight(g, 1, 0) == 1.5f);
+    assert(edge_weight(g, 1, 2) == 2.5f);
+
+    string directed = s;
+    directed.replace(directed.find("undirected"), 10, "directed");
+    ReadGraph g2;
+    assert(!read_graphml_buffer(directed, g2, false).ok());
+
+    string truncated = s.substr(0, s.find("</graph>"));
+    ReadGraph g3;
+    assert(!read_graphml_buffer(truncated, g3, false).ok());
+
+    string bad_weight = s;
+    bad_weight.replace(bad_weight.find("1.5"), 3, "x");
+    ReadGraph g4;
+    assert(!read_graphml_buffer(bad_weight, g4, false).ok());
+    cout << "test read graphml from buffer ok" << endl;
+}
+
+
 void test_read_edgelist(){
-    Graph g;
-    read_graph("../../data/miserables_edgelist", g, false);
+    ReadGraph g;
+    read_graph("../../data/miserables_edgelist", g, false, false);
     test_nb_vertices_edges(g, 77, 254);
+    assert(g.csr.offsets.back() == 2*254);
     cout << "test read edgelist ok" << endl;
 }
 
 
 void test_read_edgelist_directed(){
-    DGraph g;
-    read_graph("../../data/miserables_edgelist", g, false);
+    ReadGraph g;
+    read_graph("../../data/miserables_edgelist", g, false, true);
     test_nb_vertices_edges(g, 77, 254);
+    assert(g.csr.offsets.back() == 254);
     cout << "test read edgelist ok" << endl;
 }
 
 void test_edgelist_with_weight(){
-    Graph g;
-    auto dp = read_graph("../../data/edgelist_with_weights", g, false, true, "weight");
+    ReadGraph g;
+    read_graph("../../data/edgelist_with_weights", g, false, false, true, "weight");
     test_nb_vertices_edges(g, 5, 3);
-    auto edge = boost::edge(0, 1, g);
-    auto w = g[edge.first].weight;
+    auto w = edge_weight(g, 0, 1);
     assert(w == 10);
+
+    // A weight column without has_weights, or any extra column, is an error.
+    std::ifstream fin("../../data/edgelist_with_weights");
+    GraphBuilder unweighted(false, false);
+    Status status = gseq::read_edgelist(fin, &unweighted);
+    assert(!status.ok() && status.error_message().find("Line 2 ") == 0);
+    string extra = "# a comment with many words\na b 1 2\n";
+    GraphBuilder weighted(false, true);
+    status = gseq::read_edgelist(extra.data(), extra.size(), &weighted);
+    assert(!status.ok() && status.error_message().find("Line 2 ") == 0);
     cout << "test read edgelist with weights ok" << endl;
 }
 
 
+void test_edgelist_parallel(){
+    // Large enough to be split in several chunks.
+    std::ostringstream data;
+    data << "# header" << endl;
+    for(int i=0; i<200000; i++){
+        data << "n" << (i*7919LL)%50000 << " n" << (i*104729LL+3)%60000 << " " << (i%10)+1 << endl;
+        if(i%1000 == 0)
+            data << "# comment" << endl << endl;
+    }
+    string s = data.str();
+    thread::ThreadPool workers(Env::Default(), "test", 4);
+    ReadGraph g1, g2;
+    GraphBuilder b1(false, true), b2(false, true);
+    TF_CHECK_OK(gseq::read_edgelist(s.data(), s.size(), &b1));
+    TF_CHECK_OK(gseq::read_edgelist(s.data(), s.size(), &b2, &workers, 4));
+    finalize(b1, g1);
+    finalize(b2, g2, &workers, 4);
+    test_nb_vertices_edges(g2, g1.ids.size(), g1.nb_edges);
+    assert(g1.ids == g2.ids);
+    assert(g1.csr.offsets == g2.csr.offsets);
+    assert(g1.csr.neighbors == g2.csr.neighbors);
+    assert(g1.csr.weights == g2.csr.weights);
+    for(size_t i=0; i<g1.ids.size(); i++)
+        assert(std::is_sorted(g1.csr.neighbors.begin() + g1.csr.offsets[i],
+                              g1.csr.neighbors.begin() + g1.csr.offsets[i+1]));
+
+    // Errors report the line number in the whole file.
+    string bad = s + "n1\n";
+    GraphBuilder b3(false, true);
+    Status status = gseq::read_edgelist(bad.data(), bad.size(), &b3, &workers, 4);
+    assert(!status.ok());
+    int nb_lines = std::count(s.begin(), s.end(), '\n');
+    assert(status.error_message().find("Line " + std::to_string(nb_lines+1) + " ") == 0);
+    cout << "test read edgelist in parallel ok" << endl;
+}
+
+
+void test_integer_ids(){
+    // The same graph with string and integer ids is read the same way, the
+    // integer ids being dense (flat array) or not (hash map).
+    for(int64 scale : {1LL, -1000000007LL}){
+        std::ostringstream strings, integers;
+        for(int i=0; i<100000; i++){
+            int64 a = (i*7919LL)%30000, b = (i*104729LL+3)%40000;
+            strings << "n" << a << " n" << b << " " << (i%10)+1 << endl;
+            integers << a*scale << " " << b*scale << " " << (i%10)+1 << endl;
+        }
+        string s = strings.str(), n = integers.str();
+        ReadGraph g;
+        GraphBuilder b1(false, true), b2(false, true, true);
+        TF_CHECK_OK(gseq::read_edgelist(s.data(), s.size(), &b1));
+        TF_CHECK_OK(gseq::read_edgelist(n.data(), n.size(), &b2));
+        finalize(b1, g);
+        CSRGraph csr;
+        std::vector<int64> ids = finalize_int_ids(b2, &csr);
+        assert(ids.size() == g.ids.size());
+        for(size_t i=0; i<ids.size(); i++)
+            assert(g.ids[i] == "n" + std::to_string(ids[i]/scale));
+        assert(csr.offsets == g.csr.offsets && csr.neighbors == g.csr.neighbors && csr.weights == g.csr.weights);
+    }
+
+    for(string empty : {"", "# comments only\n#\n"}){
+        GraphBuilder b0(false, false, true);
+        TF_CHECK_OK(gseq::read_edgelist(empty.data(), empty.size(), &b0));
+        CSRGraph csr;
+        std::vector<int64> ids = finalize_int_ids(b0, &csr);
+        assert(ids.empty() && csr.neighbors.empty());
+    }
+
+    string bad = "1 2\n3 x\n";
+    GraphBuilder b3(false, false, true);
+    Status status = gseq::read_edgelist(bad.data(), bad.size(), &b3);
+    assert(!status.ok() && status.error_message().find("Line 2") == 0);
+
+    string graphml =
+        "<graphml><graph edgedefault=\"undirected\">"
+        "<node id=\"12\"/><node id=\"-3\"/><edge source=\"12\" target=\"-3\"/>"
+        "</graph></graphml>";
+    GraphBuilder b4(false, false, true);
+    TF_CHECK_OK(gseq::read_graphml(graphml.data(), graphml.size(), &b4, ""));
+    CSRGraph csr;
+    std::vector<int64> ids = finalize_int_ids(b4, &csr);
+    assert(ids == std::vector<int64>({12, -3}));
+    string named = graphml;
+    named.replace(named.find("12"), 2, "a");
+    GraphBuilder b5(false, false, true);
+    assert(!gseq::read_graphml(named.data(), named.size(), &b5, "").ok());
+    cout << "test read integer ids ok" << endl;
+}
+
+
+void test_int64_index_map(){
+    Int64IndexMap index;
+    for(int32 i=0; i<10000; i++)
+        index.Insert(int64(i)*(1LL << 33) - 5, i);
+    for(int32 i=0; i<10000; i++)
+        assert(index.Find(int64(i)*(1LL << 33) - 5) == i);
+    assert(index.Find(7) == -1);
+    cout << "test int64 index map ok" << endl;
+}
+
+
+void test_string_interner(){
+    StringArena ids;
+    StringInterner<StringArena> index;
+    for(int32 i=0; i<10000; i++){
+        string id = "node" + std::to_string(i);
+        assert(index.Find(ids, id, index.Hash(id)) == -1);
+        index.Insert(ids, ids.Add(id), index.Hash(id));
+    }
+    for(int32 i=0; i<10000; i++){
+        string id = "node" + std::to_string(i);
+        assert(index.Find(ids, id, index.Hash(id)) == i);
+        assert(ids[i] == id);
+    }
+    // Strings longer than an arena block get a block of their own.
+    string long_id(3 << 20, 'x');
+    assert(ids[ids.Add(long_id)] == long_id);
+    assert(ids[0] == "node0");
+
+    GraphBuilder builder(false, false);
+    assert(builder.InternVertex("a") == 0);
+    assert(builder.InternVertex("b") == 1);
+    assert(builder.InternVertex("a") == 0);
+    assert(builder.NumVertices() == 2);
+    ReadGraph g;
+    finalize(builder, g);
+    assert(g.ids.size() == 2 && g.ids[0] == "a" && g.ids[1] == "b");
+    cout << "test string interner ok" << endl;
+}
+
+
+void test_read_graph_file(){
+    // The file of the kernels, mapped in memory, and an empty file, which
+    // can't be.
+    GraphBuilder builder(false, false);
+    TF_CHECK_OK(gseq::read_graph(Env::Default(), "../../data/miserables_edgelist", &builder, ""));
+    assert(builder.NumVertices() == 77 && builder.NumEdges() == 254);
+    string empty = "test_empty_edgelist";
+    std::ofstream(empty.c_str());
+    GraphBuilder empty_builder(false, false);
+    TF_CHECK_OK(gseq::read_graph(Env::Default(), empty, &empty_builder, ""));
+    assert(empty_builder.NumVertices() == 0 && empty_builder.NumEdges() == 0);
+    std::remove(empty.c_str());
+    cout << "test read graph file ok" << endl;
+}
+
+
 int main(){
     test_read_graphml();
+    test_read_graphml_buffer();
     test_read_edgelist();
     test_read_edgelist_directed();
     test_edgelist_with_weight();
+    test_edgelist_parallel();
+    test_integer_ids();
+    test_int64_index_map();
+    test_string_interner();
+    test_read_graph_file();
     return 0;
 }
\ No newline at end of file
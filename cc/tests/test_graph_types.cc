@@ -1,31 +1,293 @@
 #include <iostream>
 #include <cassert>
+#include <set>
+#include <tuple>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include "graph_reader.h"
 #include "graph_kernel_base.h"
 
 using namespace gseq;
 
-typedef typename graph_types<true>::Graph DGraph;
-typedef typename graph_types<false>::Graph Graph;
 
-template <typename G>
-bool is_directed(G &g)
-{
-  // Typedef of an object whose constructor returns "directedness" of the graph object.
-  typedef typename boost::graph_traits<G>::directed_category Cat;
-  // The function boost::detail::is_directed() returns "true" if the graph object is directed.
-  return boost::detail::is_directed(Cat());
+// Builds csr as the kernels do and returns the vertex ids of the tensor.
+std::vector<string> finalize(GraphBuilder& builder, CSRGraph* csr, const string& order = "none"){
+    Tensor ids(DT_STRING, TensorShape({builder.NumVertices()}));
+    TF_CHECK_OK(builder.Finalize(csr, order, &ids));
+    std::vector<string> result(ids.NumElements());
+    for(size_t i=0; i<result.size(); ++i)
+        result[i] = ids.flat<string>()(i);
+    return result;
+}
+
+
+CSRGraph build(bool directed){
+    GraphBuilder builder(directed, false);
+    int a = builder.InternVertex("a");
+    int b = builder.InternVertex("b");
+    int c = builder.InternVertex("c");
+    builder.AddEdge(a, c);
+    builder.AddEdge(a, b);
+    builder.AddEdge(c, c);
+    builder.AddEdge(a, b);
+    CSRGraph csr;
+    std::vector<string> ids = finalize(builder, &csr);
+    assert(ids == std::vector<string>({"a", "b", "c"}));
+    assert(builder.NumVertices() == 0 && builder.NumEdges() == 0);
+    return csr;
 }
 
 
 void test_graph_types(){
-    DGraph dg;
-    Graph g;
-    assert(is_directed(dg) && !is_directed(g));
+    // Rows are sorted, parallel edges are kept.
+    CSRGraph dg = build(true);
+    assert(dg.offsets == std::vector<EdgeOffset>({0, 3, 3, 4}));
+    assert(dg.neighbors == std::vector<VertexIndex>({1, 1, 2, 2}));
+    // Undirected edges are stored both ways, self loops once.
+    CSRGraph g = build(false);
+    assert(g.offsets == std::vector<EdgeOffset>({0, 3, 5, 7}));
+    assert(g.neighbors == std::vector<VertexIndex>({1, 1, 2, 0, 0, 0, 2}));
+    assert(g.weights.empty());
+}
+
+// Weighted edges as pairs of vertex ids, to compare graphs whatever their
+// numbering.
+std::multiset<std::tuple<string, string, float>> named_edges(const CSRGraph& csr, const std::vector<string>& ids){
+    std::multiset<std::tuple<string, string, float>> edges;
+    for(size_t i=0; i+1<csr.offsets.size(); ++i)
+        for(EdgeOffset k=csr.offsets[i]; k<csr.offsets[i+1]; ++k)
+            edges.insert(std::make_tuple(ids[i], ids[csr.neighbors[k]], csr.weights[k]));
+    return edges;
+}
+
+
+// A path a - b - c - d with a chord b - d, listed out of order, renumbered
+// to order.
+std::vector<string> build_path(const string& order, CSRGraph* csr){
+    GraphBuilder builder(false, true);
+    int d = builder.InternVertex("d");
+    int b = builder.InternVertex("b");
+    int a = builder.InternVertex("a");
+    int c = builder.InternVertex("c");
+    builder.AddEdge(a, b, 1.);
+    builder.AddEdge(b, c, 2.);
+    builder.AddEdge(c, d, 3.);
+    builder.AddEdge(b, d, 4.);
+    return finalize(builder, csr, order);
+}
+
+
+void test_reorder(){
+    CSRGraph csr;
+    std::vector<string> ids = build_path("none", &csr);
+    assert(ids == std::vector<string>({"d", "b", "a", "c"}));
+    auto edges = named_edges(csr, ids);
+    for(string order : {"degree", "rcm"}){
+        CSRGraph permuted;
+        std::vector<string> permuted_ids = build_path(order, &permuted);
+        assert(named_edges(permuted, permuted_ids) == edges);
+        for(size_t i=0; i+1<permuted.offsets.size(); ++i)
+            assert(std::is_sorted(permuted.neighbors.begin() + permuted.offsets[i],
+                                  permuted.neighbors.begin() + permuted.offsets[i+1]));
+    }
+    // b has the highest degree, a the lowest.
+    CSRGraph by_degree;
+    std::vector<string> degree_ids = build_path("degree", &by_degree);
+    assert(degree_ids.front() == "b" && degree_ids.back() == "a");
+    GraphBuilder builder(false, false);
+    Tensor no_ids(DT_STRING, TensorShape({0}));
+    assert(!builder.Finalize(&by_degree, "random", &no_ids).ok());
+    cout << "test reorder OK" << endl;
+}
+
+
+void test_finalize_to_tensor(){
+    // Ids written to a tensor by Finalize follow the vertices when the
+    // graph is renumbered.
+    for(bool integer_ids : {false, true}){
+        for(string order : {"none", "degree", "rcm"}){
+            GraphBuilder unordered(false, true, integer_ids), ordered(false, true, integer_ids);
+            for(GraphBuilder* builder : {&unordered, &ordered}){
+                for(int i=0; i<50; ++i){
+                    if(integer_ids)
+                        builder->AddIntVertex(1000 - i);
+                    else
+                        builder->InternVertex("n" + std::to_string(i));
+                }
+                for(int i=0; i<200; ++i)
+                    builder->AddEdge((i*7)%50, (i*13+5)%50, i%5 + 1);
+            }
+            DataType id_type = integer_ids ? DT_INT64 : DT_STRING;
+            CSRGraph expected, csr;
+            Tensor unordered_ids(id_type, TensorShape({unordered.NumVertices()}));
+            Tensor ids(id_type, TensorShape({ordered.NumVertices()}));
+            TF_CHECK_OK(unordered.Finalize(&expected, "none", &unordered_ids));
+            TF_CHECK_OK(ordered.Finalize(&csr, order, &ids));
+            std::vector<VertexIndex> permutation;
+            TF_CHECK_OK(vertex_order(order, expected, &permutation));
+            if(permutation.empty())
+                for(VertexIndex i=0; i<50; ++i)
+                    permutation.push_back(i);
+            else
+                permute_csr(permutation, &expected);
+            for(VertexIndex i=0; i<50; ++i){
+                if(integer_ids)
+                    assert(ids.flat<int64>()(i) == unordered_ids.flat<int64>()(permutation[i]));
+                else
+                    assert(ids.flat<string>()(i) == unordered_ids.flat<string>()(permutation[i]));
+            }
+            assert(csr.offsets == expected.offsets && csr.neighbors == expected.neighbors
+                   && csr.weights == expected.weights);
+            assert(ordered.NumVertices() == 0);
+        }
+    }
+    cout << "test finalize to tensor OK" << endl;
 }
 
+
+// Hub h with leaves l0..l11 whose rows are much shorter than the row of h,
+// l0 - l1 closing a triangle with h, a clique c0..c4 hanging from h with a
+// self loop and a parallel edge, and an isolated vertex z.
+CSRGraph edge_alias_graph(){
+    GraphBuilder builder(false, true);
+    int h = builder.InternVertex("h");
+    for(int i=0; i<12; ++i)
+        builder.AddEdge(h, builder.InternVertex("l" + std::to_string(i)), i%3 + 1);
+    builder.AddEdge(1, 2, 2.);
+    int c0 = builder.InternVertex("c0");
+    for(int i=1; i<5; ++i)
+        builder.InternVertex("c" + std::to_string(i));
+    for(int i=0; i<5; ++i)
+        for(int j=i+1; j<5; ++j)
+            builder.AddEdge(c0+i, c0+j, i + j + 1);
+    builder.AddEdge(c0+2, c0+2, 1.);
+    builder.AddEdge(c0+3, c0+4, 2.);
+    builder.AddEdge(h, c0, 1.);
+    builder.InternVertex("z");
+    CSRGraph csr;
+    finalize(builder, &csr);
+    return csr;
+}
+
+
+// Distribution of the table of d entries starting at start.
+std::vector<double> alias_distribution(const EdgeAliasTable& table, int64 start, int d){
+    std::vector<double> dist(d, 0.);
+    for(int i=0; i<d; ++i){
+        double proba = std::min(1.f, table.probas[start+i]);
+        dist[i] += proba/d;
+        if(proba < 1.)
+            dist[table.aliases[start+i]] += (1. - proba)/d;
+    }
+    return dist;
+}
+
+
+void test_edge_alias(){
+    CSRGraph csr = edge_alias_graph();
+    VertexIndex nb_vertices = csr.offsets.size() - 1;
+    float p = 0.5, q = 2.;
+    auto degree = [&csr](VertexIndex node){
+        return static_cast<int>(csr.offsets[node+1] - csr.offsets[node]);
+    };
+    thread::ThreadPool workers(Env::Default(), "test_edge_alias", 3);
+
+    // The tables do not depend on how the targets are split over threads.
+    EdgeAliasTable full, sharded;
+    int64 nb_pairs = setup_edge_alias(csr, full, p, q, true, -1, nullptr, 1);
+    assert(nb_pairs == csr.offsets.back());
+    assert(setup_edge_alias(csr, sharded, p, q, true, -1, &workers, 4) == nb_pairs);
+    assert(full.starts == sharded.starts && full.probas == sharded.probas && full.aliases == sharded.aliases);
+
+    // Every table matches the node2vec weights, common neighbors being
+    // checked here by a scan of the source row.
+    for(VertexIndex target=0; target<nb_vertices; ++target){
+        int d = degree(target);
+        const VertexIndex* row = &csr.neighbors[csr.offsets[target]];
+        for(int j=0; j<d; ++j){
+            VertexIndex source = row[j];
+            std::vector<double> expected(d);
+            double sum = 0;
+            for(int k=0; k<d; ++k){
+                bool common = false;
+                for(EdgeOffset e=csr.offsets[source]; e<csr.offsets[source+1]; ++e)
+                    common = common || csr.neighbors[e] == row[k];
+                double bias = row[k] == source ? 1./p : (common ? 1. : 1./q);
+                expected[k] = csr.weights[csr.offsets[target]+k]*bias;
+                sum += expected[k];
+            }
+            std::vector<double> dist = alias_distribution(full, full.starts[csr.offsets[target]+j], d);
+            for(int k=0; k<d; ++k)
+                assert(std::abs(dist[k] - expected[k]/sum) < 1e-4);
+        }
+    }
+
+    // With a tight budget, the starts of every edge and whole tables of
+    // the lowest degree targets are kept, the other pairs are left to
+    // rejection sampling. Without room for a table, nothing is kept.
+    int64 starts_bytes = csr.neighbors.size()*EDGE_ALIAS_PAIR_BYTES;
+    int min_degree = std::numeric_limits<int>::max();
+    for(VertexIndex target=0; target<nb_vertices; ++target)
+        if(degree(target) > 0)
+            min_degree = std::min(min_degree, degree(target));
+    for(int64 budget : {int64(0), int64(100), starts_bytes, starts_bytes + 100, starts_bytes + 1000}){
+        EdgeAliasTable tight, tight_sharded;
+        int64 nb_tight = setup_edge_alias(csr, tight, p, q, true, budget, nullptr, 1);
+        assert(setup_edge_alias(csr, tight_sharded, p, q, true, budget, &workers, 4) == nb_tight);
+        assert(tight.starts == tight_sharded.starts && tight.probas == tight_sharded.probas
+               && tight.aliases == tight_sharded.aliases);
+        bool fits = budget - starts_bytes >= min_degree*EDGE_ALIAS_ENTRY_BYTES;
+        assert(edge_alias_fits(csr.offsets, budget) == fits);
+        if(!fits){
+            assert(nb_tight == 0 && tight.starts.empty() && tight.probas.empty() && tight.aliases.empty());
+            continue;
+        }
+        assert(tight.starts.size() == csr.neighbors.size() && tight.probas.size() == tight.aliases.size());
+        int64 used = starts_bytes;
+        int64 nb_with_table = 0;
+        int max_covered = 0;
+        int min_uncovered = std::numeric_limits<int>::max();
+        for(VertexIndex target=0; target<nb_vertices; ++target){
+            int d = degree(target);
+            bool missing = false;
+            for(int j=0; j<d; ++j){
+                int64 start = tight.starts[csr.offsets[target]+j];
+                if(start < 0){
+                    missing = true;
+                    continue;
+                }
+                // Pairs with a table are the first ones of their target.
+                assert(!missing);
+                ++nb_with_table;
+                used += d*EDGE_ALIAS_ENTRY_BYTES;
+                assert(start + d <= static_cast<int64>(tight.probas.size()));
+                std::vector<double> dist = alias_distribution(tight, start, d);
+                std::vector<double> expected = alias_distribution(full, full.starts[csr.offsets[target]+j], d);
+                for(int k=0; k<d; ++k)
+                    assert(std::abs(dist[k] - expected[k]) < 1e-4);
+                max_covered = std::max(max_covered, d);
+            }
+            if(missing)
+                min_uncovered = std::min(min_uncovered, d);
+        }
+        assert(nb_with_table == nb_tight && nb_tight > 0);
+        assert(used <= budget);
+        assert(starts_bytes + static_cast<int64>(tight.probas.size())*EDGE_ALIAS_ENTRY_BYTES == used);
+        assert(max_covered <= min_uncovered);
+        // The budget left has no room for another pair.
+        assert(budget - used < min_uncovered*EDGE_ALIAS_ENTRY_BYTES);
+        assert(nb_tight < nb_pairs);
+    }
+    cout << "test edge alias OK" << endl;
+}
+
+
 int main(){
     test_graph_types();
+    test_reorder();
+    test_finalize_to_tensor();
+    test_edge_alias();
     cout << "test graph types OK" << endl;
     return 0;
-}
\ No newline at end of file
+}
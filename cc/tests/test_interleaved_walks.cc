@@ -0,0 +1,98 @@
+#include <iostream>
+#include <cassert>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include "sampling.h"
+
+using namespace gseq;
+using namespace std;
+
+
+// Every node has degree neighbors drawn at random, so that consecutive
+// steps of a walk touch unrelated rows.
+AliasTable make_random_table(int nb_nodes, int degree, bool weighted){
+    random::PhiloxRandom phi(1, 2);
+    random::SimplePhilox gen(&phi);
+    AliasTable table;
+    table.offsets.resize(nb_nodes+1);
+    table.idx.resize(int64(nb_nodes)*degree);
+    for(int i=0; i<=nb_nodes; ++i)
+        table.offsets[i] = i*degree;
+    for(auto& node : table.idx)
+        node = gen.Uniform(nb_nodes);
+    if(weighted){
+        table.probas.resize(table.idx.size());
+        table.aliases.resize(table.idx.size());
+        for(int i=0; i<nb_nodes; ++i){
+            float sum_weights = 0;
+            for(int j=0; j<degree; ++j){
+                table.probas[i*degree+j] = 1 + gen.RandFloat();
+                sum_weights += table.probas[i*degree+j];
+            }
+            setup_alias_vectors(&table.probas[i*degree], &table.aliases[i*degree], degree, sum_weights);
+        }
+    }
+    return table;
+}
+
+
+// Generates nb_walks walks of size nodes, either one by one or
+// WALK_GROUP_SIZE at a time, and returns the number of steps per second.
+double generate_walks(const AliasTable& table, bool weighted, bool interleaved,
+                      int nb_walks, int size, std::vector<VertexIndex>* out){
+    int nb_nodes = table.offsets.size() - 1;
+    out->resize(int64(nb_walks)*size);
+    auto begin = std::chrono::steady_clock::now();
+    random::PhiloxRandom phis[WALK_GROUP_SIZE];
+    std::vector<random::SimplePhilox> gens;
+    gens.reserve(WALK_GROUP_SIZE);
+    VertexIndex* walks[WALK_GROUP_SIZE];
+    for(int group=0; group<nb_walks; group+=WALK_GROUP_SIZE){
+        int n = std::min(WALK_GROUP_SIZE, nb_walks - group);
+        gens.clear();
+        for(int w=0; w<n; ++w){
+            walks[w] = out->data() + int64(group + w)*size;
+            walks[w][0] = (int64(group + w)*7919) % nb_nodes;
+            phis[w] = random::PhiloxRandom(42, group + w);
+            gens.emplace_back(&phis[w]);
+        }
+        if(interleaved){
+            interleaved_walks<false>(table, walks, n, size, [&](int k, VertexIndex* nodes){
+                VertexIndex cur_nodes[WALK_GROUP_SIZE];
+                for(int w=0; w<n; ++w)
+                    cur_nodes[w] = walks[w][k-1];
+                sample_first_order(table, cur_nodes, weighted, gens.data(), nodes, n);
+            });
+        }
+        else{
+            for(int w=0; w<n; ++w)
+                for(int k=1; k<size; ++k)
+                    walks[w][k] = sample_first_order(table, walks[w][k-1], weighted, gens[w]);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    return int64(nb_walks)*(size-1)/seconds;
+}
+
+
+void test_interleaved_walks(int nb_nodes, int degree, int nb_walks, bool weighted){
+    AliasTable table = make_random_table(nb_nodes, degree, weighted);
+    std::vector<VertexIndex> walks, interleaved_walks;
+    double per_walk = generate_walks(table, weighted, false, nb_walks, 40, &walks);
+    double lockstep = generate_walks(table, weighted, true, nb_walks, 40, &interleaved_walks);
+    // Each walk draws from its own stream, in the same order either way.
+    assert(walks == interleaved_walks);
+    cout << "test interleaved walks ok: " << nb_nodes << " nodes" << (weighted ? ", weighted" : "")
+         << ", per walk " << per_walk/1e6 << "M steps/s, interleaved " << lockstep/1e6 << "M steps/s" << endl;
+}
+
+
+int main(int argc, char** argv){
+    // Pass a number of nodes to benchmark a graph larger than the cache.
+    int nb_nodes = argc > 1 ? atoi(argv[1]) : 1<<20;
+    test_interleaved_walks(1000, 8, 2000, false);
+    test_interleaved_walks(nb_nodes, 8, 50000, false);
+    test_interleaved_walks(nb_nodes, 8, 50000, true);
+    return 0;
+}
@@ -0,0 +1,274 @@
+#include <iostream>
+#include <cassert>
+#include <cmath>
+#include <algorithm>
+#include "sampling.h"
+#include "graph_kernel_base.h"
+
+using namespace gseq;
+using namespace std;
+
+
+AliasTable make_table(){
+    // Node 0 -> {1, 2, 3} with weights {1, 2, 5}, node 1 has no neighbor,
+    // node 2 -> {0} with weight 3.
+    AliasTable table;
+    table.offsets = {0, 3, 3, 4};
+    table.idx = {1, 2, 3, 0};
+    table.probas = {1., 2., 5., 3.};
+    table.aliases.resize(4);
+    setup_alias_vectors(&table.probas[0], &table.aliases[0], 3, 8.);
+    setup_alias_vectors(&table.probas[3], &table.aliases[3], 1, 3.);
+    return table;
+}
+
+
+void test_alias_table_distribution(){
+    AliasTable table = make_table();
+    random::PhiloxRandom phi(42, 7);
+    random::SimplePhilox gen(&phi);
+    int counts[4] = {0, 0, 0, 0};
+    int n = 80000;
+    for(int i=0; i<n; i++){
+        counts[sample_alias(table, 0, gen)]++;
+        assert(sample_alias(table, 2, gen) == 0);
+    }
+    assert(counts[0] == 0);
+    assert(std::abs(counts[1]/(float)n - 1./8) < 0.01);
+    assert(std::abs(counts[2]/(float)n - 2./8) < 0.01);
+    assert(std::abs(counts[3]/(float)n - 5./8) < 0.01);
+    cout << "test alias table distribution ok" << endl;
+}
+
+
+void test_uniform_sampling(){
+    AliasTable table = make_table();
+    random::PhiloxRandom phi(42, 7);
+    random::SimplePhilox gen(&phi);
+    int counts[4] = {0, 0, 0, 0};
+    int n = 30000;
+    for(int i=0; i<n; i++){
+        counts[sample_uniform(table, 0, gen)]++;
+    }
+    assert(degree(table, 0) == 3 && degree(table, 1) == 0 && degree(table, 2) == 1);
+    for(int i=1; i<4; i++){
+        assert(std::abs(counts[i]/(float)n - 1./3) < 0.01);
+    }
+    cout << "test uniform sampling ok" << endl;
+}
+
+
+void test_batched_sampling(){
+    // Batched samplers draw the same samples as the scalar ones.
+    AliasTable table = make_table();
+    random::PhiloxRandom phi(42, 7), batch_phi(42, 7);
+    random::SimplePhilox gen(&phi), batch_gen(&batch_phi);
+    int n = 1003;
+    std::vector<int32> positions(n);
+    sample_alias(&table.probas[0], &table.aliases[0], 3, batch_gen, positions.data(), n);
+    for(int i=0; i<n; i++){
+        assert(positions[i] == sample_alias(&table.probas[0], &table.aliases[0], 3, gen));
+    }
+
+    std::vector<random::PhiloxRandom> phis, batch_phis;
+    for(int i=0; i<n; i++){
+        phis.emplace_back(i, 3);
+        batch_phis.emplace_back(i, 3);
+    }
+    std::vector<random::SimplePhilox> gens, batch_gens;
+    std::vector<VertexIndex> nodes(n), samples(n);
+    for(int i=0; i<n; i++){
+        gens.emplace_back(&phis[i]);
+        batch_gens.emplace_back(&batch_phis[i]);
+        nodes[i] = i % 3 == 1 ? 0 : i % 3;
+    }
+    for(bool weighted : {true, false}){
+        sample_first_order(table, nodes.data(), weighted, batch_gens.data(), samples.data(), n);
+        for(int i=0; i<n; i++){
+            assert(samples[i] == sample_first_order(table, nodes[i], weighted, gens[i]));
+        }
+    }
+    cout << "test batched sampling ok" << endl;
+}
+
+
+void test_compressed_rows(){
+    // Rows around the block size, with repeated neighbors and large gaps.
+    random::PhiloxRandom phi(3, 5);
+    random::SimplePhilox gen(&phi);
+    AliasTable table;
+    table.offsets = {0};
+    for(int d : {0, 1, 5, 31, 32, 33, 64, 65, 200, 1000}){
+        std::vector<VertexIndex> row(d);
+        for(auto& v : row)
+            v = gen.Uniform(d < 100 ? 50 : 1 << 30);
+        std::sort(row.begin(), row.end());
+        table.idx.insert(table.idx.end(), row.begin(), row.end());
+        table.offsets.push_back(table.idx.size());
+    }
+    AliasTable compressed;
+    compressed.offsets = table.offsets;
+    compress_rows(table.offsets, table.idx, &compressed.compressed);
+    assert(is_compressed(compressed) && !is_compressed(table));
+    VertexIndex nb_nodes = table.offsets.size() - 1;
+    for(VertexIndex node=0; node<nb_nodes; node++){
+        int d = degree(table, node);
+        std::vector<VertexIndex> row(d);
+        decompress_row(compressed.compressed, node, d, row.data());
+        assert(std::equal(row.begin(), row.end(), table.idx.begin() + table.offsets[node]));
+        for(int k=0; k<d; k++){
+            assert(row_neighbor(compressed, node, k) == row[k]);
+            assert(neighbor_position(compressed, node, row[k]) == neighbor_position(table, node, row[k]));
+        }
+        for(VertexIndex v : {0, 1, 25, 49, 1 << 29, (1 << 30) - 1}){
+            assert(neighbor_position(compressed, node, v) == neighbor_position(table, node, v));
+            assert(has_neighbor(compressed, node, v) == has_neighbor(table, node, v));
+        }
+        random::PhiloxRandom phi1(node, 1), phi2(node, 1);
+        random::SimplePhilox gen1(&phi1), gen2(&phi2);
+        for(int i=0; d>0 && i<100; i++)
+            assert(sample_uniform(compressed, node, gen1) == sample_uniform(table, node, gen2));
+    }
+    cout << "test compressed rows ok: " << compressed.compressed.bytes.size() << " bytes for "
+         << table.idx.size()*sizeof(VertexIndex) << " uncompressed" << endl;
+}
+
+
+// Node 0 - {1, 2, 3}, 1 - {0, 2, 4}, 2 - {0, 1, 3, 5}, 3 - {0, 2}, 4 - {1, 5}
+// and 5 - {2, 4}, so that steps can return, stay next to the previous node
+// or move away from it.
+CSRGraph make_node2vec_graph(){
+    GraphBuilder builder(false, true);
+    for(int i=0; i<6; i++)
+        builder.InternVertex(std::to_string(i));
+    int edges[8][2] = {{0, 1}, {0, 2}, {0, 3}, {1, 2}, {1, 4}, {2, 3}, {2, 5}, {4, 5}};
+    for(int i=0; i<8; i++)
+        builder.AddEdge(edges[i][0], edges[i][1], i%3 + 1);
+    CSRGraph csr;
+    Tensor ids(DT_STRING, TensorShape({builder.NumVertices()}));
+    TF_CHECK_OK(builder.Finalize(&csr, "none", &ids));
+    return csr;
+}
+
+
+void test_rejection_acceptance(){
+    AliasTable table;
+    std::vector<VertexIndex> valid_nodes;
+    setup_node_alias(make_node2vec_graph(), table, valid_nodes, false, false);
+    // After 0 -> 1, 0 is a return, 2 a neighbor of 0 and 4 moves away.
+    Node2VecBias bias = node2vec_bias(4., 2.);
+    assert(bias.min_bias == 0.25 && bias.max_bias == 1.);
+    for(VertexIndex candidate : {0, 2, 4})
+        assert(accept_candidate<false>(table, bias, 0, candidate, 0.2));
+    assert(!accept_candidate<false>(table, bias, 0, 0, 0.3));
+    assert(accept_candidate<false>(table, bias, 0, 2, 0.3) && accept_candidate<false>(table, bias, 0, 4, 0.3));
+    assert(accept_candidate<false>(table, bias, 0, 2, 0.6) && !accept_candidate<false>(table, bias, 0, 4, 0.6));
+    bias = node2vec_bias(0.5, 0.25);
+    assert(bias.min_bias == 1. && bias.max_bias == 4.);
+    for(VertexIndex candidate : {0, 2, 4})
+        assert(accept_candidate<false>(table, bias, 0, candidate, 0.9));
+    assert(!accept_candidate<false>(table, bias, 0, 2, 1.5));
+    assert(accept_candidate<false>(table, bias, 0, 0, 1.5) && accept_candidate<false>(table, bias, 0, 4, 1.5));
+    assert(!accept_candidate<false>(table, bias, 0, 0, 3.) && accept_candidate<false>(table, bias, 0, 4, 3.));
+    cout << "test rejection acceptance ok" << endl;
+}
+
+
+void test_rejection_distribution(){
+    // Rejection sampling draws the steps with the distribution of the edge
+    // alias tables.
+    CSRGraph csr = make_node2vec_graph();
+    VertexIndex nb_nodes = csr.offsets.size() - 1;
+    random::PhiloxRandom phi(11, 3);
+    random::SimplePhilox gen(&phi);
+    float params[4][2] = {{0.25, 4.}, {4., 0.25}, {0.5, 0.5}, {2., 1.}};
+    int n = 20000;
+    for(bool weighted : {true, false}){
+        AliasTable table;
+        std::vector<VertexIndex> valid_nodes;
+        setup_node_alias(csr, table, valid_nodes, weighted, false);
+        for(auto& pq : params){
+            Node2VecBias bias = node2vec_bias(pq[0], pq[1]);
+            EdgeAliasTable edge_table;
+            setup_edge_alias(csr, edge_table, pq[0], pq[1], weighted, -1, nullptr, 1);
+            for(VertexIndex cur=0; cur<nb_nodes; cur++){
+                int d = degree(table, cur);
+                for(int j=0; j<d; j++){
+                    VertexIndex prev = row_neighbor(table, cur, j);
+                    int64 start = edge_alias_start(table, edge_table, prev, cur);
+                    std::vector<double> expected(d, 0.);
+                    for(int i=0; i<d; i++){
+                        double proba = std::min(1.f, edge_table.probas[start+i]);
+                        expected[i] += proba/d;
+                        if(proba < 1.)
+                            expected[edge_table.aliases[start+i]] += (1. - proba)/d;
+                    }
+                    std::vector<int> counts(d, 0);
+                    for(int i=0; i<n; i++){
+                        VertexIndex next = weighted ? sample_rejection<true, false>(table, bias, prev, cur, gen)
+                                                    : sample_rejection<false, false>(table, bias, prev, cur, gen);
+                        counts[neighbor_position(table, cur, next)]++;
+                    }
+                    for(int i=0; i<d; i++)
+                        assert(std::abs(counts[i]/(double)n - expected[i]) < 0.015);
+                }
+            }
+        }
+    }
+    cout << "test rejection distribution ok" << endl;
+}
+
+
+void test_compressed_samplers(){
+    // The samplers instantiated for compressed rows draw the same nodes as
+    // those for flat rows.
+    CSRGraph csr = make_node2vec_graph();
+    VertexIndex nb_nodes = csr.offsets.size() - 1;
+    AliasTable flat, compressed;
+    std::vector<VertexIndex> valid_nodes;
+    setup_node_alias(csr, flat, valid_nodes, true, false);
+    setup_node_alias(csr, compressed, valid_nodes, true, true);
+    assert(is_compressed(compressed) && !is_compressed(flat));
+    EdgeAliasTable edge_table;
+    setup_edge_alias(csr, edge_table, 0.5, 2., true, -1, nullptr, 1);
+    Node2VecBias bias = node2vec_bias(0.5, 2.);
+    random::PhiloxRandom phi1(5, 1), phi2(5, 1);
+    random::SimplePhilox gen1(&phi1), gen2(&phi2);
+    std::vector<VertexIndex> nodes, out1(nb_nodes), out2(nb_nodes);
+    for(VertexIndex cur=0; cur<nb_nodes; cur++)
+        nodes.push_back(cur);
+    for(int i=0; i<100; i++){
+        sample_first_order<true, false>(flat, nodes.data(), &gen1, out1.data(), 1);
+        sample_first_order<true, true>(compressed, nodes.data(), &gen2, out2.data(), 1);
+        assert(out1 == out2);
+    }
+    for(VertexIndex cur=0; cur<nb_nodes; cur++){
+        for(int j=0; j<degree(flat, cur); j++){
+            VertexIndex prev = row_neighbor<false>(flat, cur, j);
+            assert(row_neighbor<true>(compressed, cur, j) == prev);
+            assert(edge_alias_start<true>(compressed, edge_table, prev, cur)
+                   == edge_alias_start<false>(flat, edge_table, prev, cur));
+            for(int i=0; i<100; i++){
+                VertexIndex weighted = sample_rejection<true, true>(compressed, bias, prev, cur, gen1);
+                VertexIndex expected = sample_rejection<true, false>(flat, bias, prev, cur, gen2);
+                assert(weighted == expected);
+                VertexIndex uniform = sample_rejection<false, true>(compressed, bias, prev, cur, gen1);
+                expected = sample_rejection<false, false>(flat, bias, prev, cur, gen2);
+                assert(uniform == expected);
+            }
+        }
+    }
+    cout << "test compressed samplers ok" << endl;
+}
+
+
+int main(){
+    test_alias_table_distribution();
+    test_uniform_sampling();
+    test_batched_sampling();
+    test_compressed_rows();
+    test_rejection_acceptance();
+    test_rejection_distribution();
+    test_compressed_samplers();
+    return 0;
+}
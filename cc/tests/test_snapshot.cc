@@ -0,0 +1,151 @@
+#include <iostream>
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <cstring>
+#include "graph_snapshot.h"
+#include "compressed_rows.h"
+
+using namespace gseq;
+using namespace std;
+
+
+void test_snapshot_roundtrip(){
+    string fname = "test_snapshot.bin";
+    Tensor vocab(DT_STRING, TensorShape({3}));
+    vocab.flat<string>()(0) = "a";
+    vocab.flat<string>()(1) = "";
+    vocab.flat<string>()(2) = "node with spaces";
+    std::vector<int32> ints = {1, 2, 3};
+    std::vector<float> floats = {0.5, 0.25};
+    std::vector<int64> empty;
+
+    SnapshotWriter writer;
+    TF_CHECK_OK(writer.Open(Env::Default(), fname));
+    TF_CHECK_OK(writer.WriteScalar<int32>(7));
+    TF_CHECK_OK(writer.WriteStrings(vocab));
+    TF_CHECK_OK(writer.WriteArray(ints));
+    TF_CHECK_OK(writer.WriteArray(empty));
+    TF_CHECK_OK(writer.WriteArray(floats));
+    TF_CHECK_OK(writer.Close());
+
+    SnapshotReader reader;
+    int32 scalar;
+    Tensor vocab2;
+    std::vector<int32> ints2;
+    std::vector<int64> empty2 = {4};
+    std::vector<float> floats2;
+    TF_CHECK_OK(reader.Open(Env::Default(), fname));
+    TF_CHECK_OK(reader.ReadScalar(&scalar));
+    TF_CHECK_OK(reader.ReadStrings(&vocab2));
+    TF_CHECK_OK(reader.ReadArray(&ints2));
+    TF_CHECK_OK(reader.ReadArray(&empty2));
+    TF_CHECK_OK(reader.ReadArray(&floats2));
+    assert(scalar == 7);
+    assert(vocab2.NumElements() == 3);
+    for(int i=0; i<3; i++)
+        assert(vocab2.flat<string>()(i) == vocab.flat<string>()(i));
+    assert(ints2 == ints && empty2.empty() && floats2 == floats);
+    // Reading past the last record fails instead of returning garbage.
+    assert(!reader.ReadArray(&ints2).ok());
+    std::remove(fname.c_str());
+    cout << "test snapshot roundtrip ok" << endl;
+}
+
+
+void test_snapshot_bad_file(){
+    SnapshotReader reader;
+    assert(!reader.Open(Env::Default(), "../../data/miserables_edgelist").ok());
+    // An empty file is read rather than mapped, and is no snapshot either.
+    string empty = "test_empty_snapshot.bin";
+    std::ofstream(empty.c_str());
+    SnapshotReader empty_reader;
+    assert(errors::IsDataLoss(empty_reader.Open(Env::Default(), empty)));
+    std::remove(empty.c_str());
+    cout << "test snapshot bad file ok" << endl;
+}
+
+
+void test_snapshot_corrupted_vocabulary(){
+    // Offsets ending at the blob size but going back and forth would read
+    // past the blob.
+    string fname = "test_snapshot.bin";
+    std::vector<uint64> offsets = {0, 10, 3};
+    string blob = "abc";
+    SnapshotWriter writer;
+    TF_CHECK_OK(writer.Open(Env::Default(), fname));
+    TF_CHECK_OK(writer.WriteArray(offsets));
+    TF_CHECK_OK(writer.WriteBytes(blob.data(), blob.size()));
+    TF_CHECK_OK(writer.Close());
+    SnapshotReader reader;
+    Tensor vocab;
+    TF_CHECK_OK(reader.Open(Env::Default(), fname));
+    Status status = reader.ReadStrings(&vocab);
+    assert(errors::IsDataLoss(status));
+    std::remove(fname.c_str());
+    cout << "test snapshot corrupted vocabulary ok" << endl;
+}
+
+
+// Writes rows to a snapshot and reads them back.
+CompressedRows write_and_read(const CompressedRows& rows){
+    string fname = "test_snapshot.bin";
+    SnapshotWriter writer;
+    TF_CHECK_OK(writer.Open(Env::Default(), fname));
+    TF_CHECK_OK(writer.WriteArray(rows.starts));
+    TF_CHECK_OK(writer.WriteArray(rows.bytes));
+    TF_CHECK_OK(writer.Close());
+    SnapshotReader reader;
+    CompressedRows read;
+    TF_CHECK_OK(reader.Open(Env::Default(), fname));
+    TF_CHECK_OK(reader.ReadArray(&read.starts));
+    TF_CHECK_OK(reader.ReadArray(&read.bytes));
+    std::remove(fname.c_str());
+    return read;
+}
+
+
+void test_snapshot_corrupted_compressed_rows(){
+    // A short row, a row of three blocks with a skip table and an empty row.
+    std::vector<EdgeOffset> offsets = {0, 3, 3 + 70, 3 + 70};
+    std::vector<VertexIndex> idx = {1, 5, 300};
+    for(int k=0; k<70; k++)
+        idx.push_back(k*1000);
+    CompressedRows rows;
+    compress_rows(offsets, idx, &rows);
+    assert(check_compressed_rows(write_and_read(rows), offsets));
+
+    CompressedRows decreasing = rows;
+    decreasing.starts[1] = decreasing.starts[2] + 1;
+    assert(!check_compressed_rows(write_and_read(decreasing), offsets));
+
+    CompressedRows short_bytes = rows;
+    short_bytes.bytes.pop_back();
+    assert(!check_compressed_rows(write_and_read(short_bytes), offsets));
+
+    // Second row: its skip table starts at its first byte.
+    CompressedRows bad_skip = rows;
+    uint32 offset = 1 << 30;
+    memcpy(&bad_skip.bytes[bad_skip.starts[1]], &offset, sizeof(offset));
+    assert(!check_compressed_rows(write_and_read(bad_skip), offsets));
+
+    // The last varint of the second row runs into the end of the bytes.
+    CompressedRows unterminated = rows;
+    unterminated.bytes.back() |= 0x80;
+    assert(!check_compressed_rows(write_and_read(unterminated), offsets));
+
+    // More rows than offsets.
+    CompressedRows extra_row = rows;
+    extra_row.starts.push_back(extra_row.starts.back());
+    assert(!check_compressed_rows(write_and_read(extra_row), offsets));
+    cout << "test snapshot corrupted compressed rows ok" << endl;
+}
+
+
+int main(){
+    test_snapshot_roundtrip();
+    test_snapshot_bad_file();
+    test_snapshot_corrupted_vocabulary();
+    test_snapshot_corrupted_compressed_rows();
+    return 0;
+}
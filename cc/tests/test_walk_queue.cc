@@ -0,0 +1,72 @@
+#include <iostream>
+#include <cassert>
+#include <thread>
+#include <vector>
+#include "walk_queue.h"
+
+using namespace gseq;
+using namespace std;
+
+
+void test_walk_queue_bounds(){
+    WalkQueue<int> queue(2);
+    int value = 1;
+    assert(queue.TryPush(value));
+    value = 2;
+    assert(queue.TryPush(value));
+    value = 3;
+    assert(!queue.TryPush(value) && value == 3);
+    int popped;
+    assert(queue.TryPop(&popped) && popped == 1);
+    assert(queue.TryPush(value));
+    assert(queue.TryPop(&popped) && popped == 2);
+    assert(queue.TryPop(&popped) && popped == 3);
+    assert(!queue.TryPop(&popped));
+    cout << "test walk queue bounds ok" << endl;
+}
+
+
+void test_walk_queue_concurrent(){
+    // Every value pushed by some producer is popped exactly once.
+    const int nb_producers = 4;
+    const int nb_consumers = 4;
+    const int nb_values = 100000;
+    WalkQueue<int> queue(7);
+    std::vector<std::vector<int>> popped(nb_consumers);
+    std::vector<std::thread> threads;
+    for(int p=0; p<nb_producers; p++){
+        threads.emplace_back([&queue, p](){
+            for(int v=p; v<nb_values; v+=nb_producers){
+                int value = v;
+                while(!queue.TryPush(value))
+                    std::this_thread::yield();
+            }
+        });
+    }
+    for(int c=0; c<nb_consumers; c++){
+        threads.emplace_back([&queue, &popped, c](){
+            for(int n=0; n<nb_values/nb_consumers; n++){
+                int value;
+                while(!queue.TryPop(&value))
+                    std::this_thread::yield();
+                popped[c].push_back(value);
+            }
+        });
+    }
+    for(auto& t : threads)
+        t.join();
+    std::vector<int> count(nb_values, 0);
+    for(auto& values : popped)
+        for(int v : values)
+            count[v]++;
+    for(int v=0; v<nb_values; v++)
+        assert(count[v] == 1);
+    cout << "test walk queue concurrent ok" << endl;
+}
+
+
+int main(){
+    test_walk_queue_bounds();
+    test_walk_queue_concurrent();
+    return 0;
+}
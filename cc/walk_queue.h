@@ -0,0 +1,91 @@
+#ifndef WALK_QUEUE_H
+#define WALK_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+namespace gseq{
+
+// Bounded multi-producer multi-consumer queue, after Dmitry Vyukov's array
+// based design. Every cell carries a sequence number telling whether it can
+// be written or read at a given position, so pushes and pops only claim a
+// position with a compare and swap and never take a lock. TryPush and TryPop
+// fail instead of waiting when the queue is full or empty.
+template<typename T>
+class WalkQueue {
+public:
+    explicit WalkQueue(size_t capacity)
+        : capacity_(capacity), cells_(new Cell[capacity]) {
+        for(size_t i=0; i<capacity_; ++i)
+            cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    size_t capacity() const {return capacity_;}
+
+    // Moves value into the queue, unless it is full.
+    bool TryPush(T& value){
+        Cell* cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        while(true){
+            cell = &cells_[pos % capacity_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if(diff == 0){
+                if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0){
+                return false;
+            }
+            else{
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->value = std::move(value);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool TryPop(T* value){
+        Cell* cell;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        while(true){
+            cell = &cells_[pos % capacity_];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos + 1);
+            if(diff == 0){
+                if(head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0){
+                return false;
+            }
+            else{
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        *value = std::move(cell->value);
+        cell->value = T();
+        cell->sequence.store(pos + capacity_, std::memory_order_release);
+        return true;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T value;
+    };
+
+    const size_t capacity_;
+    std::unique_ptr<Cell[]> cells_;
+    // Kept on separate cache lines, producers and consumers each update one.
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+} // Namespace
+
+#endif // WALK_QUEUE_H
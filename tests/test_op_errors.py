@@ -0,0 +1,27 @@
+import tensorflow as tf
+
+from tensorflow_node2vec.utils import mod
+
+
+def expect_invalid_argument(op):
+    with tf.Session() as sess:
+        try:
+            sess.run(op)
+        except tf.errors.InvalidArgumentError as e:
+            print(e.message)
+            return
+    assert False, "expected InvalidArgumentError"
+
+
+def test_bad_attrs(fname):
+    # The op must report the error rather than start walking without a
+    # queue.
+    expect_invalid_argument(mod.rand_walk_seq(fname, size=10, batchsize=0))
+    expect_invalid_argument(mod.rand_walk_seq(fname, size=10, num_batches=0))
+    expect_invalid_argument(mod.rand_walk_seq(fname, size=10, subsample=-1.))
+    expect_invalid_argument(mod.node2_vec_seq(fname, size=10, p=0.5, q=2., batchsize=0))
+
+
+if __name__ == "__main__":
+    test_bad_attrs("../data/miserables_edgelist")
+    print("Test bad attrs OK")
@@ -3,7 +3,7 @@ import networkx as nx
 from collections import Counter
 from scipy.stats import chisquare
 
-from tensorflow_node2vec.utils import generate_random_walks
+from tensorflow_node2vec.utils import generate_random_walks, walks_as_words
 
 
 def test_epoch_walks_per_start_node(walks, graph, n_epochs):
@@ -36,6 +36,18 @@ def test_distrib(graph, vocab, vocab_to_int):
         assert isnan(pvalue) or pvalue > 0.025, pvalue
 
 
+def test_subsampled_words(fname, size):
+    walks, vocab = generate_random_walks(fname, size, 1, batchsize=10, subsample=1e-3)
+    words = walks_as_words(walks, vocab)
+    nb_kept = sum((wbatch >= 0).sum() for wbatch in walks)
+    assert nb_kept < sum(wbatch.size for wbatch in walks)
+    # Padding is dropped rather than read as the last node of the vocab.
+    assert sum(len(w) for w in words) == nb_kept
+    rows = [walk_ for wbatch in walks for walk_ in wbatch]
+    for walk_, words_ in zip(rows, words):
+        assert words_ == [vocab[w] for w in walk_[walk_ >= 0]]
+
+
 if __name__ == "__main__":
     n_epochs = 30
     graph = nx.read_graphml("../data/miserables.graphml")
@@ -46,3 +58,5 @@ if __name__ == "__main__":
     print("Test epoch OK")
     test_distrib(graph, vocab, vocab_to_int)
     print("Test distrib OK")
+    test_subsampled_words("../data/miserables.graphml", 50)
+    print("Test subsampled words OK")
@@ -15,7 +15,8 @@ def _generate_walks(n_epochs, vocab, walk, epoch, total, nb_valid):
     config.inter_op_parallelism_threads = 4
     with tf.Session(config=config) as sess:
         vocab_, walk_, nb_valid_ = sess.run([vocab, walk, nb_valid])
-        vocab_ = [v.decode("utf8") for v in vocab_]
+        if vocab_.dtype == object:
+            vocab_ = [v.decode("utf8") for v in vocab_]
         walks.append(walk_)
         prev = 0
         with tqdm(total=nb_valid_*n_epochs) as pbar:
@@ -29,15 +30,22 @@ def _generate_walks(n_epochs, vocab, walk, epoch, total, nb_valid):
 
 
 def walks_as_words(walks, vocab):
+    # walks is a list of batches, subsampled walks are padded with -1.
     out = []
-    for walk_ in walks:
-        out.append([vocab[w] for w in walk_])
+    for wbatch in walks:
+        for walk_ in wbatch:
+            out.append([vocab[w] for w in walk_ if w >= 0])
     return out
 
 
-def generate_random_walks(fname, size, epochs, as_words=False, batchsize=256):
+def generate_random_walks(fname, size, epochs, as_words=False, batchsize=256,
+                          snapshot="", seed=0, seed2=0, num_batches=1, subsample=0,
+                          reorder="none", integer_ids=False, compress_adjacency=False):
     vocab, walk, epoch, total, nb_valid = mod.rand_walk_seq(
-        fname, size=size, batchsize=batchsize)
+        fname, size=size, batchsize=batchsize, snapshot=snapshot,
+        seed=seed, seed2=seed2, num_batches=num_batches, subsample=subsample,
+        reorder=reorder, id_type=tf.int64 if integer_ids else tf.string,
+        compress_adjacency=compress_adjacency)
     walks, vocab_ = _generate_walks(
         epochs, vocab, walk, epoch, total, nb_valid)
     if as_words:
@@ -45,9 +53,17 @@ def generate_random_walks(fname, size, epochs, as_words=False, batchsize=256):
     return walks, vocab_
 
 
-def generate_n2v_walks(fname, size, epochs, p=1, q=1, as_words=False, batchsize=256):
+def generate_n2v_walks(fname, size, epochs, p=1, q=1, as_words=False, batchsize=256,
+                       rejection_sampling=False, memory_budget=-1, snapshot="",
+                       seed=0, seed2=0, num_batches=1, subsample=0, reorder="none",
+                       integer_ids=False, compress_adjacency=False):
     vocab, walk, epoch, total, nb_valid = mod.node2_vec_seq(
-        fname, size=size, p=p, q=q, batchsize=256)
+        fname, size=size, p=p, q=q, batchsize=256,
+        rejection_sampling=rejection_sampling, memory_budget=memory_budget,
+        snapshot=snapshot, seed=seed, seed2=seed2, num_batches=num_batches,
+        subsample=subsample, reorder=reorder,
+        id_type=tf.int64 if integer_ids else tf.string,
+        compress_adjacency=compress_adjacency)
     walks, vocab_ = _generate_walks(
         epochs, vocab, walk, epoch, total, nb_valid)
     if as_words: